@@ -0,0 +1,142 @@
+//////////////////////////////////////
+//// MERGE KERNEL CHECK + BENCHMARK //
+//////////////////////////////////////
+
+/*
+
+Checks the fused merge kernel (src/HistKernels.h) against the old way
+MergeRootfile did it (fix the errors bin by bin, Scale, then Add, each
+through virtual calls like on a TH1) and times both on wide histograms.
+
+Doesn't need ROOT.  Build and run with
+
+  make bench
+  ./bench/MergeKernelBench
+
+ */
+
+#include "src/HistKernels.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <stdint.h>
+
+using namespace std;
+
+//// Stand in for a TH1D.  Calls go through the vtable and aren't inlined,
+/// same as calling a TH1 in the ROOT library
+class RefHist {
+ public:
+  RefHist(int nbins): nbins(nbins), content(nbins+2), sumw2(nbins+2) {}
+  virtual ~RefHist() {}
+
+  __attribute__((noinline)) virtual double GetBinContent(int i) const {return content[i];}
+  __attribute__((noinline)) virtual double GetBinError(int i) const {return sqrt(sumw2[i]);}
+  __attribute__((noinline)) virtual void SetBinError(int i, double err) {sumw2[i] = err*err;}
+  __attribute__((noinline)) virtual double GetBinErrorSqUnchecked(int i) const {return sumw2[i];}
+
+  //// same math as TH1::Scale and TH1::Add(h, c)
+  virtual void Scale(double c) {
+    for(int i = 0; i < nbins+2; i++) content[i] = c * GetBinContent(i);
+    for(int i = 0; i < nbins+2; i++) sumw2[i] *= (c * c);
+  }
+  virtual void Add(const RefHist* h, double c) {
+    for(int i = 0; i < nbins+2; i++) {
+      content[i] += c * h->GetBinContent(i);
+      sumw2[i] += c * c * h->GetBinErrorSqUnchecked(i);
+    }
+  }
+
+  int nbins;
+  vector<double> content, sumw2;
+};
+
+//// old MergeRootfile error loop
+void oldSanitize(RefHist* h) {
+  for(int i = 1; i <= h->nbins; i++) {
+    if(h->GetBinError(i) != h->GetBinError(i) || h->GetBinError(i) > h->GetBinContent(i)) {
+      h->SetBinError(i, abs(h->GetBinContent(i)));
+    }
+  }
+}
+
+//// contents with some negative, empty and NaN bins, errors on both
+/// sides of the content so both branches of the error fix get used
+vector<RefHist*> makeInputs(int nbins, int ninputs, mt19937_64& rng) {
+  uniform_real_distribution<double> flat(0, 1);
+  vector<RefHist*> inputs;
+  for(int n = 0; n < ninputs; n++) {
+    RefHist* h = new RefHist(nbins);
+    for(int i = 0; i < nbins+2; i++) {
+      double r = flat(rng);
+      double c = (r < 0.05) ? -flat(rng) : (r < 0.1) ? 0 : 100*flat(rng);
+      h->content[i] = c;
+      h->sumw2[i] = (r > 0.999) ? -1 : abs(c) * 2 * flat(rng) * flat(rng) * 100;
+    }
+    inputs.push_back(h);
+  }
+  return inputs;
+}
+
+bool sameBits(const vector<double>& a, const vector<double>& b) {
+  return a.size() == b.size() && memcmp(a.data(), b.data(), a.size()*sizeof(double)) == 0;
+}
+
+int main() {
+  mt19937_64 rng(12345);
+  const int ninputs = 20;
+  bool allgood = true;
+
+  cout << setw(8) << "bins" << setw(14) << "old (ms)" << setw(14) << "fused (ms)" << setw(10) << "speedup" << setw(10) << "same" << endl;
+
+  for(int nbins: {10000, 50000, 200000}) {
+    vector<RefHist*> inputs = makeInputs(nbins, ninputs, rng);
+    vector<double> scales;
+    uniform_real_distribution<double> flat(1e-3, 2);
+    for(int n = 0; n < ninputs; n++) scales.push_back(flat(rng));
+    int repeat = max(1, 2000000 / nbins);
+
+    //// old: copy, fix, Scale the first one, then fix + Add the rest
+    RefHist oldSum(nbins);
+    auto start = chrono::steady_clock::now();
+    for(int r = 0; r < repeat; r++) {
+      RefHist first = *inputs[0];
+      oldSanitize(&first);
+      first.Scale(scales[0]);
+      for(int n = 1; n < ninputs; n++) {
+	RefHist next = *inputs[n];
+	oldSanitize(&next);
+	first.Add(&next, scales[n]);
+      }
+      oldSum = first;
+    }
+    double oldTime = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / repeat;
+
+    //// fused: same copies, one pass per input
+    RefHist newSum(nbins);
+    start = chrono::steady_clock::now();
+    for(int r = 0; r < repeat; r++) {
+      RefHist first = *inputs[0];
+      fusedScale(first.content.data(), first.sumw2.data(), nbins, scales[0], true);
+      for(int n = 1; n < ninputs; n++) {
+	RefHist next = *inputs[n];
+	fusedAccumulate(first.content.data(), first.sumw2.data(), next.content.data(), next.sumw2.data(), nbins, scales[n], true);
+      }
+      newSum = first;
+    }
+    double newTime = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / repeat;
+
+    bool same = sameBits(oldSum.content, newSum.content) && sameBits(oldSum.sumw2, newSum.sumw2);
+    allgood = allgood && same;
+    cout << setw(8) << nbins << setw(14) << fixed << setprecision(3) << oldTime << setw(14) << newTime
+	 << setw(10) << setprecision(2) << oldTime/newTime << setw(10) << (same ? "yes" : "NO") << endl;
+
+    for(auto h: inputs) delete h;
+  }
+
+  return allgood ? 0 : 1;
+}
@@ -0,0 +1,275 @@
+//////////////////////////////////////
+//// PLOT KERNEL CHECK + BENCHMARK ///
+//////////////////////////////////////
+
+/*
+
+Checks the plotting kernels (src/PlotKernels.h) against the old Plotter
+loops (GetBinContent/SetBinContent/GetBinWidth one bin at a time, Add
+and Divide like on a TH1) and times both on wide histograms with
+variable bins.
+
+addBins, divideBins, ratioWindow and maxBin have to give the same bits,
+divideByWidth and errorBand can be off in the last bits.
+
+Doesn't need ROOT.  Build and run with
+
+  make bench
+  ./bench/PlotKernelBench
+
+ */
+
+#include "src/PlotKernels.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <stdint.h>
+
+using namespace std;
+
+//// Stand in for a TH1D with variable bins.  Calls go through the vtable
+/// and aren't inlined, same as calling a TH1 in the ROOT library
+class RefHist {
+ public:
+  RefHist(int nbins): nbins(nbins), content(nbins+2), sumw2(nbins+2), edges(nbins+1) {}
+  virtual ~RefHist() {}
+
+  __attribute__((noinline)) virtual double GetBinContent(int i) const {return content[i];}
+  __attribute__((noinline)) virtual void SetBinContent(int i, double c) {content[i] = c;}
+  __attribute__((noinline)) virtual double GetBinError(int i) const {return sqrt(sumw2[i]);}
+  __attribute__((noinline)) virtual void SetBinError(int i, double err) {sumw2[i] = err*err;}
+  __attribute__((noinline)) virtual double GetBinErrorSqUnchecked(int i) const {return sumw2[i];}
+  __attribute__((noinline)) virtual double GetBinWidth(int i) const {return edges[i] - edges[i-1];}
+  __attribute__((noinline)) virtual double GetBinCenter(int i) const {return 0.5*(edges[i-1] + edges[i]);}
+
+  //// same math as TH1::Add(h) and TH1::Divide(h1, h2)
+  virtual void Add(const RefHist* h) {
+    for(int i = 0; i < nbins+2; i++) {
+      content[i] += h->GetBinContent(i);
+      sumw2[i] += h->GetBinErrorSqUnchecked(i);
+    }
+  }
+  virtual void Divide(const RefHist* h1, const RefHist* h2) {
+    for(int i = 0; i < nbins+2; i++) {
+      double b1 = h1->GetBinContent(i), b2 = h2->GetBinContent(i);
+      double e1sq = h1->GetBinErrorSqUnchecked(i), e2sq = h2->GetBinErrorSqUnchecked(i);
+      if(b2 == 0) {
+	content[i] = sumw2[i] = 0;
+	continue;
+      }
+      content[i] = b1/b2;
+      double b1sq = b1*b1, b2sq = b2*b2;
+      sumw2[i] = (e1sq*b2sq + e2sq*b1sq)/(b2sq*b2sq);
+    }
+  }
+
+  int nbins;
+  vector<double> content, sumw2, edges;
+};
+
+//// falling spectrum with some empty bins and bins that get wider
+RefHist* makeHist(int nbins, double scale, mt19937_64& rng) {
+  uniform_real_distribution<double> flat(0, 1);
+  RefHist* h = new RefHist(nbins);
+  for(int i = 0; i <= nbins; i++) h->edges[i] = 10.0*i + 0.001*i*i;
+  for(int i = 0; i < nbins+2; i++) {
+    double c = (flat(rng) < 0.05) ? 0 : scale * exp(-3.0*i/nbins) * (0.5 + flat(rng));
+    h->content[i] = c;
+    h->sumw2[i] = c * 0.1 * flat(rng);
+  }
+  return h;
+}
+
+//// biggest difference in units of the last place (0 means same bits)
+long maxUlps(const double* a, const double* b, int n) {
+  long worst = 0;
+  for(int i = 0; i < n; i++) {
+    if(memcmp(&a[i], &b[i], sizeof(double)) == 0 || (a[i] != a[i] && b[i] != b[i])) continue;
+    int64_t ia, ib;
+    memcpy(&ia, &a[i], 8);
+    memcpy(&ib, &b[i], 8);
+    worst = max(worst, (a[i] != a[i] || b[i] != b[i]) ? (long)1 << 40 : labs((long)(ia - ib)));
+  }
+  return worst;
+}
+
+long maxUlps(const vector<double>& a, const vector<double>& b) {
+  return maxUlps(a.data(), b.data(), a.size());
+}
+
+//// the old Plotter loops
+void oldDivideBin(RefHist* h) {
+  for(int i = 0; i < h->nbins; i++) {
+    h->SetBinContent(i+1, h->GetBinContent(i+1)/h->GetBinWidth(i+1));
+    h->SetBinError(i+1, h->GetBinError(i+1)/h->GetBinWidth(i+1));
+  }
+}
+
+void oldErrorBand(const RefHist* error, bool ratio, double* x, double* y, double* ex, double* ey) {
+  for(int bin = 0; bin < error->nbins; bin++) {
+    y[bin] = (ratio) ? 1.0 : error->GetBinContent(bin+1);
+    ey[bin] = (ratio) ? error->GetBinError(bin+1)/error->GetBinContent(bin+1) : error->GetBinError(bin+1);
+    x[bin] = error->GetBinCenter(bin+1);
+    ex[bin] = error->GetBinWidth(bin+1) * 0.5;
+  }
+}
+
+void oldRatioWindow(const RefHist* h, double& low, double& high) {
+  low = 2.99;
+  high = 0.0;
+  for(int i = 0; i < h->nbins; i++) {
+    double tmpval = h->GetBinContent(i+1);
+    if(tmpval < 2.99 && tmpval > high) {high = tmpval;}
+    if(tmpval > 0. && tmpval < low) {low = tmpval;}
+  }
+}
+
+double oldMax(const RefHist* h) {
+  double high = -DBL_MAX;
+  for(int i = 1; i <= h->nbins; i++) high = (h->GetBinContent(i) > high) ? h->GetBinContent(i) : high;
+  return high;
+}
+
+//// ms per call of f, repeated until about 0.2 s has gone by
+double timeIt(function<void()> f) {
+  int repeat = 1;
+  while(true) {
+    auto start = chrono::steady_clock::now();
+    for(int r = 0; r < repeat; r++) f();
+    double took = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    if(took > 200 || repeat > (1 << 24)) return took / repeat;
+    repeat *= 4;
+  }
+}
+
+int main() {
+  mt19937_64 rng(12345);
+  const int nbkg = 8;
+  bool allgood = true;
+
+  cout << setw(9) << "bins" << setw(14) << "kernel" << setw(12) << "old (ms)" << setw(12) << "new (ms)"
+       << setw(10) << "speedup" << setw(10) << "max ulps" << endl;
+
+  for(int nbins: {1000, 10000, 100000}) {
+    RefHist* data = makeHist(nbins, 1000, rng);
+    RefHist* signal = makeHist(nbins, 50, rng);
+    vector<RefHist*> bkgs;
+    for(int n = 0; n < nbkg; n++) bkgs.push_back(makeHist(nbins, 100*(n+1), rng));
+    RefHist* background = new RefHist(*bkgs[0]);
+    for(int n = 1; n < nbkg; n++) background->Add(bkgs[n]);
+
+    auto report = [&](const char* name, double oldTime, double newTime, long ulps, bool exact) {
+      bool good = (exact) ? ulps == 0 : ulps < 16;
+      allgood = allgood && good;
+      cout << setw(9) << nbins << setw(14) << name << setw(12) << fixed << setprecision(4) << oldTime << setw(12) << newTime
+	   << setw(10) << setprecision(1) << oldTime/newTime << setw(10) << ulps << (good ? "" : "  BAD") << endl;
+    };
+
+    //// divideBin on everything that gets drawn
+    {
+      vector<RefHist> oldOut, newOut;
+      double oldTime = timeIt([&]() {
+	  oldOut.assign(bkgs.size(), *data);
+	  for(int n = 0; n < nbkg; n++) {
+	    oldOut[n] = *bkgs[n];
+	    oldDivideBin(&oldOut[n]);
+	  }
+	});
+      double newTime = timeIt([&]() {
+	  newOut.assign(bkgs.size(), *data);
+	  for(int n = 0; n < nbkg; n++) {
+	    newOut[n] = *bkgs[n];
+	    divideByWidth(newOut[n].content.data(), newOut[n].sumw2.data(), newOut[n].edges.data(), nbins);
+	  }
+	});
+      long ulps = 0;
+      for(int n = 0; n < nbkg; n++) ulps = max(ulps, max(maxUlps(oldOut[n].content, newOut[n].content), maxUlps(oldOut[n].sumw2, newOut[n].sumw2)));
+      report("divideByWidth", oldTime, newTime, ulps, false);
+    }
+
+    //// the summed histogram the binning is worked out on
+    {
+      RefHist oldSum(nbins), newSum(nbins);
+      double oldTime = timeIt([&]() {
+	  oldSum = *data;
+	  for(auto h: bkgs) oldSum.Add(h);
+	  oldSum.Add(signal);
+	});
+      double newTime = timeIt([&]() {
+	  newSum = *data;
+	  for(auto h: bkgs) addBins(newSum.content.data(), newSum.sumw2.data(), h->content.data(), h->sumw2.data(), nbins);
+	  addBins(newSum.content.data(), newSum.sumw2.data(), signal->content.data(), signal->sumw2.data(), nbins);
+	});
+      report("addBins", oldTime, newTime, max(maxUlps(oldSum.content, newSum.content), maxUlps(oldSum.sumw2, newSum.sumw2)), true);
+    }
+
+    //// ratio plot: data/(signal+background) and data/background
+    {
+      RefHist oldTotal(nbins), newTotal(nbins), oldRatio(nbins), newRatio(nbins);
+      double oldTime = timeIt([&]() {
+	  oldTotal = *signal;
+	  oldTotal.Add(background);
+	  oldTotal.Divide(data, &oldTotal);
+	  oldRatio = *data;
+	  oldRatio.Divide(data, background);
+	});
+      double newTime = timeIt([&]() {
+	  newTotal = *signal;
+	  double *w = newTotal.content.data(), *w2 = newTotal.sumw2.data();
+	  addBins(w, w2, background->content.data(), background->sumw2.data(), nbins);
+	  divideBins(data->content.data(), data->sumw2.data(), w, w2, w, w2, nbins);
+	  newRatio = *data;
+	  divideBins(newRatio.content.data(), newRatio.sumw2.data(), background->content.data(), background->sumw2.data(),
+		     newRatio.content.data(), newRatio.sumw2.data(), nbins);
+	});
+      long ulps = max(max(maxUlps(oldTotal.content, newTotal.content), maxUlps(oldTotal.sumw2, newTotal.sumw2)),
+		      max(maxUlps(oldRatio.content, newRatio.content), maxUlps(oldRatio.sumw2, newRatio.sumw2)));
+      report("divideBins", oldTime, newTime, ulps, true);
+
+      //// ratio window of the data/MC plot
+      double oldLow, oldHigh, newLow, newHigh;
+      oldTime = timeIt([&]() {oldRatioWindow(&oldRatio, oldLow, oldHigh);});
+      newTime = timeIt([&]() {ratioWindow(newRatio.content.data(), nbins, 2.99, newLow, newHigh);});
+      report("ratioWindow", oldTime, newTime, max(maxUlps(&oldLow, &newLow, 1), maxUlps(&oldHigh, &newHigh, 1)), true);
+    }
+
+    //// error band of the stack and of the ratio
+    {
+      vector<double> oldBand(4*nbins), newBand(4*nbins);
+      double oldTime = timeIt([&]() {
+	  for(bool ratio: {false, true}) {
+	    double* b = oldBand.data();
+	    oldErrorBand(background, ratio, b, b + nbins, b + 2*nbins, b + 3*nbins);
+	  }
+	});
+      double newTime = timeIt([&]() {
+	  for(bool ratio: {false, true}) {
+	    double* b = newBand.data();
+	    errorBand(background->content.data(), background->sumw2.data(), background->edges.data(), nbins, ratio,
+		      b, b + nbins, b + 2*nbins, b + 3*nbins);
+	  }
+	});
+      report("errorBand", oldTime, newTime, maxUlps(oldBand, newBand), false);
+    }
+
+    //// maximum of the significance plots
+    {
+      double oldHigh = 0, newHigh = 0;
+      double oldTime = timeIt([&]() {oldHigh = max(oldMax(signal), oldMax(data));});
+      double newTime = timeIt([&]() {newHigh = max(maxBin(signal->content.data(), nbins), maxBin(data->content.data(), nbins));});
+      report("maxBin", oldTime, newTime, maxUlps(&oldHigh, &newHigh, 1), true);
+    }
+
+    delete data;
+    delete signal;
+    delete background;
+    for(auto h: bkgs) delete h;
+  }
+
+  return allgood ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+//////////////////////////////////////
+//// SIGNIFICANCE CHECK + BENCHMARK //
+//////////////////////////////////////
+
+/*
+
+Checks the significance kernels (src/Significance.h) against the old
+signalBottom loop (IntegralAndError over the edges for every bin, on a
+clone that is being filled in) and times both.
+
+SigLeft and SigBin have to give the same bits, SigRight can only be
+off in the last bits (its sums go from the right).
+
+Doesn't need ROOT.  Build and run with
+
+  make bench
+  ./bench/SignificanceBench
+
+ */
+
+#include "src/Significance.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+//// Stand in for a TH1D, calls through the vtable like in the ROOT library
+class RefHist {
+ public:
+  RefHist(int nbins): nbins(nbins), content(nbins+2), sumw2(nbins+2) {}
+  virtual ~RefHist() {}
+
+  __attribute__((noinline)) virtual double GetBinContent(int i) const {return content[i];}
+  __attribute__((noinline)) virtual void SetBinContent(int i, double c) {content[i] = c;}
+  __attribute__((noinline)) virtual void SetBinError(int i, double err) {sumw2[i] = err*err;}
+
+  //// same loop as TH1::DoIntegral
+  virtual double IntegralAndError(int first, int last, double& error) const {
+    double integral = 0, err2 = 0;
+    for(int i = first; i <= last; i++) {
+      integral += GetBinContent(i);
+      err2 += sumw2[i];
+    }
+    error = sqrt(err2);
+    return integral;
+  }
+
+  int nbins;
+  vector<double> content, sumw2;
+};
+
+//// the old Plotter::signalBottom loop for one signal
+void oldSignificance(RefHist* signif, const RefHist* background, SigEdge edge, bool ssqrtsb) {
+  int Nbins = signif->nbins;
+  for(int i = 0; i < Nbins;i++) {
+    if(signif->GetBinContent(i+1) <= 0 && background->GetBinContent(i+1) <= 0) continue;
+    int edge1 = i+1, edge2= i+1;
+    double sigErr, backErr;
+    if(edge == EdgeLeft) edge1 = 0;
+    if(edge == EdgeRight) edge2 = Nbins;
+    double sigInt = signif->IntegralAndError(edge1, edge2, sigErr);
+    double backInt = background->IntegralAndError(edge1, edge2, backErr);
+
+    double total = (ssqrtsb) ? sigInt/sqrt(sigInt+backInt) : sigInt/sqrt(backInt);
+    double perErr = (ssqrtsb) ? pow(sigErr/sigInt-sigErr/(2*(sigInt+backInt)),2) + pow(backErr/(2*(sigInt+backInt)),2) : pow(sigErr/sigInt,2) + pow(backErr/(2*backInt),2);
+
+    signif->SetBinContent(i+1, total);
+    signif->SetBinError(i+1, total*perErr);
+  }
+}
+
+//// falling mass spectrum with some empty bins
+RefHist* makeHist(int nbins, double scale, mt19937_64& rng) {
+  uniform_real_distribution<double> flat(0, 1);
+  RefHist* h = new RefHist(nbins);
+  for(int i = 0; i < nbins+2; i++) {
+    double c = (flat(rng) < 0.05) ? 0 : scale * exp(-3.0*i/nbins) * (0.5 + flat(rng));
+    h->content[i] = c;
+    h->sumw2[i] = c * 0.1 * flat(rng);
+  }
+  return h;
+}
+
+//// biggest difference in units of the last place (0 means same bits)
+long maxUlps(const vector<double>& a, const vector<double>& b) {
+  long worst = 0;
+  for(size_t i = 0; i < a.size(); i++) {
+    if(memcmp(&a[i], &b[i], sizeof(double)) == 0) continue;
+    int64_t ia, ib;
+    memcpy(&ia, &a[i], 8);
+    memcpy(&ib, &b[i], 8);
+    worst = max(worst, (a[i] != a[i] || b[i] != b[i]) ? (long)1 << 40 : labs((long)(ia - ib)));
+  }
+  return worst;
+}
+
+int main() {
+  mt19937_64 rng(12345);
+  const int nsignals = 6;
+  bool allgood = true;
+  const char* edgenames[3] = {"bin", "left", "right"};
+
+  cout << setw(8) << "bins" << setw(7) << "edge" << setw(8) << "s/sqrt" << setw(12) << "old (ms)" << setw(12) << "new (ms)"
+       << setw(10) << "speedup" << setw(10) << "max ulps" << endl;
+
+  for(int nbins: {200, 2000, 10000}) {
+    RefHist* background = makeHist(nbins, 1000, rng);
+    vector<RefHist*> signals;
+    for(int n = 0; n < nsignals; n++) signals.push_back(makeHist(nbins, 10*(n+1), rng));
+
+    for(int e = 0; e < 3; e++) {
+      for(bool ssqrtsb: {true, false}) {
+	SigEdge edge = (SigEdge)e;
+	int repeat = max(1, 20000000 / (nbins * ((edge == EdgeBin) ? 1 : nbins)));
+
+	vector<RefHist> oldOut;
+	auto start = chrono::steady_clock::now();
+	for(int r = 0; r < repeat; r++) {
+	  oldOut.clear();
+	  for(auto signal: signals) {
+	    oldOut.push_back(*signal);
+	    oldSignificance(&oldOut.back(), background, edge, ssqrtsb);
+	  }
+	}
+	double oldTime = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / repeat;
+
+	int newRepeat = max(1, 20000000 / nbins);
+	vector<RefHist> newOut;
+	start = chrono::steady_clock::now();
+	for(int r = 0; r < newRepeat; r++) {
+	  newOut.clear();
+	  for(auto signal: signals) {
+	    newOut.push_back(*signal);
+	    computeSignificance((ssqrtsb) ? SOverSqrtSB : SOverSqrtB, edge, newOut.back().content.data(), newOut.back().sumw2.data(),
+				background->content.data(), background->sumw2.data(), nbins);
+	  }
+	}
+	double newTime = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / newRepeat;
+
+	long ulps = 0;
+	for(int n = 0; n < nsignals; n++) {
+	  ulps = max(ulps, maxUlps(oldOut[n].content, newOut[n].content));
+	  ulps = max(ulps, maxUlps(oldOut[n].sumw2, newOut[n].sumw2));
+	}
+	//// SigRight sums in the other direction, the rest has to match exactly
+	bool good = (edge == EdgeRight) ? ulps < 1000 : ulps == 0;
+	allgood = allgood && good;
+	cout << setw(8) << nbins << setw(7) << edgenames[e] << setw(8) << ((ssqrtsb) ? "s+b" : "b")
+	     << setw(12) << fixed << setprecision(3) << oldTime << setw(12) << newTime
+	     << setw(10) << setprecision(1) << oldTime/newTime << setw(10) << ulps << (good ? "" : "  BAD") << endl;
+      }
+    }
+
+    delete background;
+    for(auto h: signals) delete h;
+  }
+
+  return allgood ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+//////////////////////////////
+//// COMPRESSION SETTINGS ////
+//////////////////////////////
+
+/*
+
+Turns a compression setting from the config or the command line
+(zlib, lzma, lz4 or zstd, with an optional level after a colon,
+ie lz4:4) into the number TFile::SetCompressionSettings wants
+(algorithm*100 + level).
+
+No level means the one ROOT recommends for that algorithm.  -1 means
+nothing was asked for, so ROOT's default is used.
+
+ */
+
+#ifndef _COMPRESSION_H_
+#define _COMPRESSION_H_
+
+#include <string>
+#include <cstdlib>
+
+using namespace std;
+
+//// -2 if the algorithm or the level isn't good
+inline int parseCompression(string setting) {
+  int level = -1;
+  size_t colon = setting.find(':');
+  if(colon != string::npos) {
+    level = atoi(setting.substr(colon+1).c_str());
+    setting.erase(colon);
+    if(level < 0 || level > 9) return -2;
+  }
+
+  int algorithm, defaultLevel;
+  if(setting == "zlib") {algorithm = 1; defaultLevel = 1;}
+  else if(setting == "lzma") {algorithm = 2; defaultLevel = 7;}
+  else if(setting == "lz4") {algorithm = 4; defaultLevel = 4;}
+  else if(setting == "zstd") {algorithm = 5; defaultLevel = 5;}
+  else return -2;
+
+  return 100*algorithm + ((level < 0) ? defaultLevel : level);
+}
+
+#endif
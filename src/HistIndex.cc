@@ -0,0 +1,61 @@
+#include "HistIndex.h"
+
+using namespace std;
+
+//// Takes the FileList array of the plotter (data, background, signal)
+/// and indexes every file in it
+HistIndex::HistIndex(TList** filelists) {
+  for(int i = 0; i < 3; i++) {
+    TFile* file = (TFile*)filelists[i]->First();
+    while(file) {
+      indexes[i].push_back(new KeyIndex(file));
+      file = (TFile*)filelists[i]->After(file);
+    }
+    missing[i] = vector<TKey*>(indexes[i].size(), (TKey*)NULL);
+    for(int j = 0; j < indexes[i].size(); j++) addDirectory(i, j, "");
+  }
+  reference = (indexes[1].size() > 0) ? indexes[1].at(0) : NULL;
+}
+
+HistIndex::~HistIndex() {
+  for(int i = 0; i < 3; i++) {
+    for(auto index: indexes[i]) delete index;
+  }
+}
+
+//// puts all the keys of file j (of type i) into the map, going into
+/// the subdirectories too
+void HistIndex::addDirectory(int i, int j, const string& path) {
+  KeyIndex* index = indexes[i].at(j);
+  for(auto& name: index->getNames(path)) {
+    if(index->isDirectory(path, name)) {
+      addDirectory(i, j, (path == "") ? name : path + "/" + name);
+      continue;
+    }
+    vector<TKey*>& slots = histkeys[i][path + "/" + name];
+    if(slots.size() == 0) slots = missing[i];
+    slots.at(j) = index->find(path, name);
+  }
+}
+
+//// Keys for histogram name in directory path for all of the files of type i
+/// (0 data, 1 background, 2 signal), in the same order as the FileList.
+/// Files without the histogram have NULL
+const vector<TKey*>& HistIndex::find(int i, const string& path, const string& name) const {
+  auto found = histkeys[i].find(path + "/" + name);
+  return (found == histkeys[i].end()) ? missing[i] : found->second;
+}
+
+//// Keys in a directory of the first background file
+const vector<string>& HistIndex::getNames(const string& path) const {
+  static const vector<string> empty;
+  return (reference) ? reference->getNames(path) : empty;
+}
+
+bool HistIndex::isDirectory(const string& path, const string& name) const {
+  return reference && reference->isDirectory(path, name);
+}
+
+TKey* HistIndex::getReference(const string& path, const string& name) const {
+  return (reference) ? reference->find(path, name) : NULL;
+}
@@ -0,0 +1,52 @@
+//////////////////////////////
+//// HISTINDEX CLASS /////////
+//////////////////////////////
+
+/*
+
+Index over all of the normalized files in the plotter.  Built once
+per run, it maps every histogram path to its TKey in each data,
+background and signal file, so gathering the histograms for one plot
+is a single lookup per file type instead of a cd and a FindObject in
+every file.
+
+The directory structure (what gets looped over to make the plots)
+comes from the first background file, same as before.
+
+ */
+
+#ifndef _HISTINDEX_H_
+#define _HISTINDEX_H_
+
+#include <TFile.h>
+#include <TKey.h>
+#include <TList.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "KeyIndex.h"
+
+using namespace std;
+
+class HistIndex {
+ public:
+  HistIndex(TList**);
+  ~HistIndex();
+
+  const vector<TKey*>& find(int, const string&, const string&) const;
+  const vector<string>& getNames(const string&) const;
+  bool isDirectory(const string&, const string&) const;
+  TKey* getReference(const string&, const string&) const;
+
+ private:
+  vector<KeyIndex*> indexes[3];
+  unordered_map<string, vector<TKey*>> histkeys[3];
+  vector<TKey*> missing[3];
+  KeyIndex* reference;
+
+  void addDirectory(int, int, const string&);
+};
+
+#endif
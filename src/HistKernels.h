@@ -0,0 +1,111 @@
+//////////////////////////////
+//// HISTOGRAM KERNELS ///////
+//////////////////////////////
+
+/*
+
+Loops that work straight on the bin arrays of a histogram (the TH1D
+or TH1F contents from GetArray() and the sumw2 from GetSumw2()) instead
+of going through GetBinContent/SetBinError one bin at a time.
+
+Arrays always have nbins+2 entries (underflow and overflow included).
+Nothing in here knows about ROOT, so the kernels can be checked and
+timed without it (see bench/).
+
+The double versions use SSE2/AVX when the compiler has them, everything
+else is a plain loop.
+
+ */
+
+#ifndef _HISTKERNELS_H_
+#define _HISTKERNELS_H_
+
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+//// The error fix from MergeRootfile for one bin: NaN errors or errors
+/// bigger than the bin content become |content|
+inline double sanitizeSumw2(double content, double sumw2) {
+  double err = sqrt(sumw2);
+  return (err != err || err > content) ? content*content : sumw2;
+}
+
+//// dst += scale*src for one bin, with the src error fixed first if asked
+template <typename T>
+inline void accumulateBin(T* dst, double* dstw2, const T* src, const double* srcw2, int i, double scale, double scale2, bool sanitize) {
+  double w2 = (sanitize) ? sanitizeSumw2(src[i], srcw2[i]) : srcw2[i];
+  dst[i] += (T)(scale * src[i]);
+  dstw2[i] += scale2 * w2;
+}
+
+//// Fused version of the merge step
+////   fix the errors of src (only bins 1 to nbins, like the old loop)
+////   dst->Add(src, scale)
+/// all in one pass.  Gives the same bits as the three separate passes
+template <typename T>
+void fusedAccumulate(T* dst, double* dstw2, const T* src, const double* srcw2, int nbins, double scale, bool sanitize) {
+  double scale2 = scale * scale;
+  accumulateBin(dst, dstw2, src, srcw2, 0, scale, scale2, false);
+  for(int i = 1; i <= nbins; i++) accumulateBin(dst, dstw2, src, srcw2, i, scale, scale2, sanitize);
+  accumulateBin(dst, dstw2, src, srcw2, nbins+1, scale, scale2, false);
+}
+
+#if defined(__AVX__) || defined(__SSE2__)
+//// double contents (TH1D) get the vector version
+template <>
+inline void fusedAccumulate<double>(double* dst, double* dstw2, const double* src, const double* srcw2, int nbins, double scale, bool sanitize) {
+  double scale2 = scale * scale;
+  accumulateBin(dst, dstw2, src, srcw2, 0, scale, scale2, false);
+
+  int i = 1;
+#ifdef __AVX__
+  __m256d vscale = _mm256_set1_pd(scale), vscale2 = _mm256_set1_pd(scale2);
+  for(; i + 4 <= nbins + 1; i += 4) {
+    __m256d c = _mm256_loadu_pd(src + i);
+    __m256d w2 = _mm256_loadu_pd(srcw2 + i);
+    if(sanitize) {
+      __m256d err = _mm256_sqrt_pd(w2);
+      __m256d bad = _mm256_or_pd(_mm256_cmp_pd(err, err, _CMP_UNORD_Q), _mm256_cmp_pd(err, c, _CMP_GT_OQ));
+      w2 = _mm256_blendv_pd(w2, _mm256_mul_pd(c, c), bad);
+    }
+    _mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(dst + i), _mm256_mul_pd(vscale, c)));
+    _mm256_storeu_pd(dstw2 + i, _mm256_add_pd(_mm256_loadu_pd(dstw2 + i), _mm256_mul_pd(vscale2, w2)));
+  }
+#else
+  __m128d vscale = _mm_set1_pd(scale), vscale2 = _mm_set1_pd(scale2);
+  for(; i + 2 <= nbins + 1; i += 2) {
+    __m128d c = _mm_loadu_pd(src + i);
+    __m128d w2 = _mm_loadu_pd(srcw2 + i);
+    if(sanitize) {
+      __m128d err = _mm_sqrt_pd(w2);
+      __m128d bad = _mm_or_pd(_mm_cmpunord_pd(err, err), _mm_cmpgt_pd(err, c));
+      w2 = _mm_or_pd(_mm_and_pd(bad, _mm_mul_pd(c, c)), _mm_andnot_pd(bad, w2));
+    }
+    _mm_storeu_pd(dst + i, _mm_add_pd(_mm_loadu_pd(dst + i), _mm_mul_pd(vscale, c)));
+    _mm_storeu_pd(dstw2 + i, _mm_add_pd(_mm_loadu_pd(dstw2 + i), _mm_mul_pd(vscale2, w2)));
+  }
+#endif
+  for(; i <= nbins; i++) accumulateBin(dst, dstw2, src, srcw2, i, scale, scale2, sanitize);
+
+  accumulateBin(dst, dstw2, src, srcw2, nbins+1, scale, scale2, false);
+}
+#endif
+
+//// Same thing done in place on one histogram: fix the errors then
+/// Scale(scale).  Used for the first input, which becomes the sum
+template <typename T>
+void fusedScale(T* content, double* sumw2, int nbins, double scale, bool sanitize) {
+  double scale2 = scale * scale;
+  for(int i = 0; i < nbins + 2; i++) {
+    double w2 = (sanitize && i > 0 && i <= nbins) ? sanitizeSumw2(content[i], sumw2[i]) : sumw2[i];
+    content[i] = (T)(scale * content[i]);
+    sumw2[i] = w2 * scale2;
+  }
+}
+
+#endif
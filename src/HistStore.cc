@@ -0,0 +1,10 @@
+#include "HistStore.h"
+
+using namespace std;
+
+//// type is "float" or "double".  Anything else gives NULL (no store)
+HistStore* HistStore::create(string type) {
+  if(type == "float") return new ColumnStore<float>();
+  else if(type == "double") return new ColumnStore<double>();
+  return NULL;
+}
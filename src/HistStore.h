@@ -0,0 +1,219 @@
+//////////////////////////////
+//// HISTSTORE CLASS /////////
+//////////////////////////////
+
+/*
+
+In memory copy of all of the normalized histograms of one group, kept
+as flat arrays instead of TH1 objects.  Every histogram in the group
+gets a slot that points into three big buffers (bin edges, sumw and
+sumw2, under/overflow included), so the plotter doesn't have to read
+the normalized file back and stream every histogram again.  Sums
+(addTo) are done straight from the buffers, a TH1D is only made
+(makeHist) for what gets drawn on its own.
+
+The sumw and sumw2 buffers are float or double (HistStore::create),
+float halves the memory for big runs.  The bin edges are always double
+and are only stored for variable binned histograms.
+
+Only 1D histograms are kept, that's all the plotter can use.  Besides
+the bins, the title, axis titles and bin labels are kept so a histogram
+made from the store draws the same as the one in the file.
+
+ */
+
+#ifndef _HISTSTORE_H_
+#define _HISTSTORE_H_
+
+#include <TH1.h>
+#include <TAxis.h>
+#include <TArrayD.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+
+using namespace std;
+
+class HistStore {
+ public:
+  virtual ~HistStore() {}
+
+  static HistStore* create(string);
+
+  virtual void add(const string&, const string&, const TH1*) = 0;
+  virtual bool has(const string&, const string&) const = 0;
+  virtual int getNbins(const string&, const string&) const = 0;
+  virtual double getContent(const string&, const string&, int) const = 0;
+  virtual double getError(const string&, const string&, int) const = 0;
+  virtual double getEntries(const string&, const string&) const = 0;
+  virtual bool addTo(const string&, const string&, double*, double*) const = 0;
+  virtual TH1D* makeHist(const string&, const string&) const = 0;
+  virtual size_t getBytes() const = 0;
+};
+
+
+template <typename T>
+class ColumnStore: public HistStore {
+ public:
+  void add(const string&, const string&, const TH1*);
+  bool has(const string& path, const string& name) const {return findSlot(path, name) != NULL;}
+  int getNbins(const string&, const string&) const;
+  double getContent(const string&, const string&, int) const;
+  double getError(const string&, const string&, int) const;
+  double getEntries(const string&, const string&) const;
+  bool addTo(const string&, const string&, double*, double*) const;
+  TH1D* makeHist(const string&, const string&) const;
+  size_t getBytes() const;
+
+  //// raw buffers of one histogram (bins 0 to nbins+1).  NULL if not there
+  const T* getSumw(const string&, const string&) const;
+  const T* getSumw2(const string&, const string&) const;
+
+ private:
+  struct Slot {
+    size_t offset;
+    long edgeOffset;     //// -1 for fixed binning
+    int nbins;
+    double xmin, xmax, entries;
+    string title, xtitle, ytitle;
+    vector<pair<int, string>> labels;   //// bin and label, only for labelled axes
+  };
+
+  unordered_map<string, Slot> slots;
+  vector<double> edges;
+  vector<T> sumw, sumw2;
+
+  const Slot* findSlot(const string& path, const string& name) const {
+    auto found = slots.find(path + "/" + name);
+    return (found == slots.end()) ? NULL : &found->second;
+  }
+};
+
+
+//// copies the histogram into the end of the buffers.  Adding the same
+/// histogram twice just overwrites the slot (old bins stay as dead space)
+template <typename T>
+void ColumnStore<T>::add(const string& path, const string& name, const TH1* hist) {
+  if(hist->GetDimension() != 1) return;
+
+  Slot slot;
+  const TAxis* xaxis = hist->GetXaxis();
+  slot.nbins = xaxis->GetNbins();
+  slot.xmin = xaxis->GetXmin();
+  slot.xmax = xaxis->GetXmax();
+  slot.entries = hist->GetEntries();
+  slot.title = hist->GetTitle();
+  slot.xtitle = xaxis->GetTitle();
+  slot.ytitle = hist->GetYaxis()->GetTitle();
+  if(xaxis->GetLabels()) {
+    for(int i = 1; i <= slot.nbins; i++) {
+      string label = xaxis->GetBinLabel(i);
+      if(label != "") slot.labels.push_back(make_pair(i, label));
+    }
+  }
+  slot.offset = sumw.size();
+  slot.edgeOffset = -1;
+
+  const TArrayD* xbins = xaxis->GetXbins();
+  if(xbins->GetSize() > 0) {
+    slot.edgeOffset = edges.size();
+    edges.insert(edges.end(), xbins->GetArray(), xbins->GetArray() + xbins->GetSize());
+  }
+
+  const TArrayD* w2 = hist->GetSumw2();
+  bool hasSumw2 = hist->GetSumw2N() > 0;
+  for(int i = 0; i < slot.nbins + 2; i++) {
+    sumw.push_back(hist->GetBinContent(i));
+    sumw2.push_back((hasSumw2) ? w2->GetArray()[i] : pow(hist->GetBinError(i), 2));
+  }
+
+  slots[path + "/" + name] = slot;
+}
+
+template <typename T>
+int ColumnStore<T>::getNbins(const string& path, const string& name) const {
+  const Slot* slot = findSlot(path, name);
+  return (slot) ? slot->nbins : 0;
+}
+
+template <typename T>
+double ColumnStore<T>::getContent(const string& path, const string& name, int bin) const {
+  const Slot* slot = findSlot(path, name);
+  return (slot) ? sumw[slot->offset + bin] : 0;
+}
+
+template <typename T>
+double ColumnStore<T>::getError(const string& path, const string& name, int bin) const {
+  const Slot* slot = findSlot(path, name);
+  return (slot) ? sqrt(sumw2[slot->offset + bin]) : 0;
+}
+
+template <typename T>
+const T* ColumnStore<T>::getSumw(const string& path, const string& name) const {
+  const Slot* slot = findSlot(path, name);
+  return (slot) ? &sumw[slot->offset] : NULL;
+}
+
+template <typename T>
+const T* ColumnStore<T>::getSumw2(const string& path, const string& name) const {
+  const Slot* slot = findSlot(path, name);
+  return (slot) ? &sumw2[slot->offset] : NULL;
+}
+
+template <typename T>
+double ColumnStore<T>::getEntries(const string& path, const string& name) const {
+  const Slot* slot = findSlot(path, name);
+  return (slot) ? slot->entries : 0;
+}
+
+//// Adds the bins (0 to nbins+1) of the slot to w and w2 straight from
+/// the buffers, like TH1::Add without making the histogram.  w2 can be
+/// NULL to only add the contents.  False if not there
+template <typename T>
+bool ColumnStore<T>::addTo(const string& path, const string& name, double* w, double* w2) const {
+  const Slot* slot = findSlot(path, name);
+  if(!slot) return false;
+  const T* slotw = &sumw[slot->offset];
+  const T* slotw2 = &sumw2[slot->offset];
+  for(int i = 0; i < slot->nbins + 2; i++) w[i] += slotw[i];
+  if(w2) {
+    for(int i = 0; i < slot->nbins + 2; i++) w2[i] += slotw2[i];
+  }
+  return true;
+}
+
+//// Makes a TH1D (not attached to any directory) out of the slot.  Used
+/// when ROOT needs an actual histogram, ie to draw it.  NULL if not there.
+/// Called from the plot workers, so the global AddDirectory is left alone
+template <typename T>
+TH1D* ColumnStore<T>::makeHist(const string& path, const string& name) const {
+  const Slot* slot = findSlot(path, name);
+  if(!slot) return NULL;
+
+  TH1D* hist = (slot->edgeOffset < 0) ?
+    new TH1D(name.c_str(), slot->title.c_str(), slot->nbins, slot->xmin, slot->xmax) :
+    new TH1D(name.c_str(), slot->title.c_str(), slot->nbins, &edges[slot->edgeOffset]);
+  hist->SetDirectory(0);
+  hist->GetXaxis()->SetTitle(slot->xtitle.c_str());
+  hist->GetYaxis()->SetTitle(slot->ytitle.c_str());
+  for(auto& label: slot->labels) hist->GetXaxis()->SetBinLabel(label.first, label.second.c_str());
+
+  hist->Sumw2();
+  double* content = hist->GetArray();
+  double* w2 = hist->GetSumw2()->GetArray();
+  for(int i = 0; i < slot->nbins + 2; i++) {
+    content[i] = sumw[slot->offset + i];
+    w2[i] = sumw2[slot->offset + i];
+  }
+  hist->SetEntries(slot->entries);
+  return hist;
+}
+
+template <typename T>
+size_t ColumnStore<T>::getBytes() const {
+  return edges.size()*sizeof(double) + (sumw.size() + sumw2.size())*sizeof(T);
+}
+
+#endif
@@ -0,0 +1,60 @@
+#include "KeyIndex.h"
+
+using namespace std;
+
+KeyIndex::KeyIndex(TDirectory* file) {
+  indexDirectory(file, "");
+}
+
+//// Key for the map.  Just path/name, so the top directory gives "/name"
+string KeyIndex::makeKey(const string& path, const string& name) {
+  return path + "/" + name;
+}
+
+//// Goes over all the keys in the directory and puts them in the map.  If
+/// the same name shows up twice, only the highest cycle is kept.  Recurses
+/// into any subdirectories
+void KeyIndex::indexDirectory(TDirectory* dir, string path) {
+  vector<string>& dirnames = names[path];
+
+  TIter nextkey( dir->GetListOfKeys() );
+  TKey *key;
+  while ( (key = (TKey*)nextkey())) {
+    string mapkey = makeKey(path, key->GetName());
+    auto found = keys.find(mapkey);
+    if(found == keys.end()) {
+      keys[mapkey] = key;
+      dirnames.push_back(key->GetName());
+    } else if(found->second->GetCycle() < key->GetCycle()) {
+      found->second = key;
+    }
+  }
+
+  for(auto& name: dirnames) {
+    if(!isDirectory(path, name)) continue;
+    TDirectory* subdir = dir->GetDirectory(name.c_str());
+    if(subdir) indexDirectory(subdir, (path == "") ? name : path + "/" + name);
+  }
+}
+
+//// returns NULL if the file doesn't have the key
+TKey* KeyIndex::find(const string& path, const string& name) const {
+  auto found = keys.find(makeKey(path, name));
+  return (found == keys.end()) ? NULL : found->second;
+}
+
+//// names of all the keys in a directory (in file order).  Empty if the
+/// directory isn't in the file
+const vector<string>& KeyIndex::getNames(const string& path) const {
+  static const vector<string> empty;
+  auto found = names.find(path);
+  return (found == names.end()) ? empty : found->second;
+}
+
+//// check the class from the key so the object doesn't need to be read
+bool KeyIndex::isDirectory(const string& path, const string& name) const {
+  TKey* key = find(path, name);
+  if(!key) return false;
+  TClass* cl = TClass::GetClass(key->GetClassName());
+  return cl && cl->InheritsFrom(TDirectory::Class());
+}
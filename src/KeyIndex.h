@@ -0,0 +1,52 @@
+//////////////////////////////
+//// KEYINDEX CLASS //////////
+//////////////////////////////
+
+/*
+
+Hash index of every key in a ROOT file.  Built once by walking the
+whole directory tree, then any (path, name) can be found without
+cd'ing into the file and doing a linear FindObject over the list
+of keys.
+
+Only the highest cycle of each key is kept, and the names of each
+directory are kept in the order they are found in the file, so
+looping over them looks the same as looping over GetListOfKeys
+(minus the old cycles).
+
+Paths are the same as the ones made in MergeRootfile/CreateStack,
+ie the part of GetPath() after the ":/", so the top directory is "".
+
+ */
+
+#ifndef _KEYINDEX_H_
+#define _KEYINDEX_H_
+
+#include <TDirectory.h>
+#include <TClass.h>
+#include <TKey.h>
+#include <TList.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+using namespace std;
+
+class KeyIndex {
+ public:
+  KeyIndex(TDirectory*);
+
+  TKey* find(const string&, const string&) const;
+  const vector<string>& getNames(const string&) const;
+  bool isDirectory(const string&, const string&) const;
+
+ private:
+  unordered_map<string, TKey*> keys;
+  unordered_map<string, vector<string>> names;
+
+  void indexDirectory(TDirectory*, string);
+  static string makeKey(const string&, const string&);
+};
+
+#endif
@@ -0,0 +1,196 @@
+#include "LabelMaker.h"
+
+using namespace std;
+
+//// Reads the rules (see LabelMaker.h) and builds the matcher.  Lines
+/// starting with // and empty lines are skipped
+void LabelMaker::readRules(string filename) {
+  ifstream rulefile(filename);
+
+  if(!rulefile) {
+    cout << "could not open file " << filename << endl;
+    exit(1);
+  }
+
+  string line, pattern = "";
+  int group = 1;
+  while(getline(rulefile, line)) {
+    if(line.size() > 0 && line.back() == '\r') line.pop_back();
+    istringstream tokens(line);
+    string type;
+    if(!(tokens >> type) || type.substr(0, 2) == "//") continue;
+
+    string rest;
+    getline(tokens >> ws, rest);
+    if(type == "latex") {
+      istringstream latexline(rest);
+      string name, value;
+      latexline >> name;
+      getline(latexline >> ws, value);
+      latex[name] = value;
+      continue;
+    } else if(type == "particles" || type == "charges") {
+      try {
+	((type == "particles") ? particles : charges) = regex(rest);
+      } catch(regex_error& error) {
+	cout << "Error: bad regex in " << filename << ": " << rest << endl;
+	exit(1);
+      }
+      continue;
+    }
+
+    size_t arrow = rest.find(" => ");
+    if((type != "match" && type != "contains") || arrow == string::npos) {
+      cout << "Error: can't read this line of " << filename << ":" << endl;
+      cout << line << endl;
+      exit(1);
+    }
+
+    //// contains is a match with the text anywhere
+    string rulepattern = rest.substr(0, arrow);
+    if(type == "contains") rulepattern = ".*" + regex_replace(rulepattern, regex("[.^$|()\\[\\]{}*+?\\\\]"), "\\$&") + ".*";
+
+    int ngroups;
+    try {
+      ngroups = regex(rulepattern).mark_count();
+    } catch(regex_error& error) {
+      cout << "Error: bad regex in " << filename << ": " << rulepattern << endl;
+      exit(1);
+    }
+
+    Rule rule;
+    rule.group = group;
+    rule.format = rest.substr(arrow + 4);
+    rules.push_back(rule);
+    pattern += ((pattern == "") ? "(" : "|(") + rulepattern + ")";
+    group += ngroups + 1;
+  }
+  rulefile.close();
+
+  matcher = regex((pattern == "") ? "$^" : pattern);
+  memo.clear();
+}
+
+//// Label for the title, remembered so each title is only worked out once
+string LabelMaker::getLabel(const string& title) {
+  {
+    lock_guard<mutex> lock(memoLock);
+    auto found = memo.find(title);
+    if(found != memo.end()) return found->second;
+  }
+
+  string label = makeLabel(title);
+  lock_guard<mutex> lock(memoLock);
+  memo[title] = label;
+  return label;
+}
+
+string LabelMaker::makeLabel(const string& title) const {
+  smatch m;
+  if(!regex_match(title, m, matcher)) return title;
+
+  for(auto& rule: rules) {
+    if(m[rule.group].matched) return fill(rule.format, m, rule.group);
+  }
+  return title;
+}
+
+//// Name in latex if there is one, the name if not
+string LabelMaker::toLatex(const string& name) const {
+  auto found = latex.find(name);
+  return (found == latex.end() || found->second == "") ? name : found->second;
+}
+
+//// The particles in toParse in latex, split by commas
+string LabelMaker::listParticles(string toParse) const {
+  smatch m;
+  bool first = true;
+  string final = "";
+
+  while(regex_search(toParse, m, particles)) {
+    if(first) first = false;
+    else final += ", ";
+    final += toLatex(m[0].str());
+    toParse = m.suffix().str();
+  }
+  return final;
+}
+
+//// q_{particle} for each particle (charges pattern) in toParse
+string LabelMaker::listCharges(string toParse) const {
+  smatch m;
+  string full = "";
+  while(regex_search(toParse, m, charges)) {
+    full += "q_{" + toLatex(m[0].str()) + "} ";
+    toParse = m.suffix().str();
+  }
+  return full;
+}
+
+//// "N" or "N+M+..." groups of the rule (offset is its own group) put
+/// together
+string LabelMaker::getGroups(const string& spec, const smatch& m, int offset) const {
+  string groups = "";
+  istringstream numbers(spec);
+  string number;
+  while(getline(numbers, number, '+')) {
+    int n = atoi(number.c_str());
+    if(n > 0 && offset + n < m.size()) groups += m[offset + n].str();
+  }
+  return groups;
+}
+
+//// Fills in the format of a rule (see LabelMaker.h)
+string LabelMaker::fill(const string& format, const smatch& m, int offset) const {
+  string label = "";
+  //// for each <if> level: is it being written, has a branch been taken
+  vector<pair<bool, bool>> levels;
+  bool writing = true;
+
+  size_t pos = 0;
+  while(pos < format.size()) {
+    size_t open = format.find('<', pos);
+    size_t close = (open == string::npos) ? string::npos : format.find('>', open);
+    if(close == string::npos) {
+      if(writing) label += format.substr(pos);
+      break;
+    }
+    if(writing) label += format.substr(pos, open - pos);
+    pos = close + 1;
+
+    istringstream tokens(format.substr(open + 1, close - open - 1));
+    string command, arg;
+    tokens >> command;
+    getline(tokens >> ws, arg);
+
+    if(command == "if" || command == "elif") {
+      size_t equals = arg.find('=');
+      string value = getGroups(arg.substr(0, equals), m, offset);
+      bool test = (equals == string::npos) ? value != "" : value == arg.substr(equals + 1);
+      if(command == "if") {
+	levels.push_back(make_pair(writing, test));
+	writing = writing && test;
+      } else if(!levels.empty()) {
+	writing = levels.back().first && !levels.back().second && test;
+	levels.back().second = levels.back().second || test;
+      }
+    } else if(command == "else" && !levels.empty()) {
+      writing = levels.back().first && !levels.back().second;
+      levels.back().second = true;
+    } else if(command == "end" && !levels.empty()) {
+      writing = levels.back().first;
+      levels.pop_back();
+    } else if(!writing) {
+      continue;
+    } else if(command == "latex") {
+      label += toLatex(getGroups(arg, m, offset));
+    } else if(command == "list") {
+      label += listParticles(getGroups(arg, m, offset));
+    } else if(command == "charges") {
+      label += listCharges(getGroups(arg, m, offset));
+    } else {
+      label += getGroups(command, m, offset);
+    }
+  }
+  return label;
+}
@@ -0,0 +1,76 @@
+//////////////////////////////
+//// LABELMAKER CLASS ////////
+//////////////////////////////
+
+/*
+
+Makes the x axis label of a plot from the histogram title
+(MuonPt -> p_{T}(#mu) [GeV]).  The rules are in style/labels, so
+changing a label doesn't need a recompile:
+
+  latex <name> <latex>            how a particle name is written
+  particles <regex>               what counts as a particle (<list>)
+  charges <regex>                 same for <charges> (the OSLS plots)
+  match <regex> => <format>       whole title matches the regex
+  contains <text> => <format>     title has text in it
+
+The first rule that fits wins, titles no rule fits are used as they
+are.  Formats are the label with these filled in (N is a group of the
+regex, N+M two groups put together):
+
+  <N>                 the group as it is
+  <latex N>           the group with its latex name if it has one
+  <list N>            latex names of the particles in it, split by ", "
+  <charges N>         q_{particle} for each particle in it
+  <if N> <elif N> <else> <end>    only if group N isn't empty (or
+                      <if N=text> if it is text)
+
+All of the rules are put together into one regex when they are read,
+so each title is one regex_match.  Labels are remembered per title.
+After readRules, getLabel can be called from many threads at once.
+
+ */
+
+#ifndef _LABELMAKER_H_
+#define _LABELMAKER_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <regex>
+#include <mutex>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+
+using namespace std;
+
+class LabelMaker {
+ public:
+  void readRules(string);
+  string getLabel(const string&);
+  string makeLabel(const string&) const;
+
+ private:
+  //// rule number i is group 'group' of the matcher, its own groups
+  /// come right after it
+  struct Rule {
+    int group;
+    string format;
+  };
+
+  vector<Rule> rules;
+  regex matcher, particles, charges;
+  unordered_map<string, string> latex;
+  unordered_map<string, string> memo;
+  mutex memoLock;
+
+  string toLatex(const string&) const;
+  string listParticles(string) const;
+  string listCharges(string) const;
+  string getGroups(const string&, const smatch&, int) const;
+  string fill(const string&, const smatch&, int) const;
+};
+
+#endif
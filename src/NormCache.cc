@@ -0,0 +1,163 @@
+#include "NormCache.h"
+
+using namespace std;
+
+const int NormCache::formatVersion;
+
+//// Reads in the old cache if there is one.  Lines are either
+//// group <normalized file> <key> <input key>
+//// file <input file> <size> <mtime> <inode> <hash>
+NormCache::NormCache(string cachename) {
+  this->cachename = cachename;
+  ifstream cachefile(cachename);
+  string line;
+  while(getline(cachefile, line)) {
+    istringstream tokens(line);
+    string type, name;
+    tokens >> type >> name;
+    if(type == "group") {
+      tokens >> groupKeys[name] >> inputKeys[name];
+    } else if(type == "file") {
+      FileHash& filehash = fileHashes[name];
+      tokens >> filehash.size >> filehash.mtime >> filehash.inode >> filehash.hash;
+    }
+  }
+  cachefile.close();
+}
+
+//// Good if the normalized file exists and was made with the same inputs
+/// and numbers as now.  With a filter, a full file is good too (it has
+/// everything the filter wants)
+bool NormCache::isCurrent(Normer& norm) {
+  struct stat buffer;
+  string filename = norm.getFilename();
+  if(stat(filename.c_str(), &buffer) != 0) return false;
+
+  auto found = groupKeys.find(filename);
+  if(found == groupKeys.end()) return false;
+  return found->second == getKey(norm) || found->second == getKey(norm, false);
+}
+
+//// Group needs to be remade, but only the numbers changed and the
+/// sidecar with the unscaled histograms (deferred scaling) is there, so
+/// it can be rescaled without reading the input files
+bool NormCache::canRescale(Normer& norm) {
+  struct stat buffer;
+  if(!norm.deferScale || stat(norm.getSidecarName().c_str(), &buffer) != 0) return false;
+
+  auto found = inputKeys.find(norm.getFilename());
+  return found != inputKeys.end() && found->second != "-" && found->second == getInputKey(norm);
+}
+
+//// call after the group has been normalized.  The input key is only kept
+/// if a sidecar that can rebuild the whole file was made with it
+void NormCache::update(Normer& norm) {
+  string filename = norm.getFilename();
+  groupKeys[filename] = getKey(norm);
+  changed = true;
+  if(norm.rescale || (norm.filter && !norm.filter->empty())) return;
+  inputKeys[filename] = (norm.deferScale && !norm.hasTrees) ? getInputKey(norm) : "-";
+}
+
+//// Writes to a temporary file and moves it over the old one so a crash
+/// in the middle doesn't leave half a cache
+void NormCache::save() {
+  string tmpname = cachename + ".tmp";
+  ofstream cachefile(tmpname);
+  for(auto& group: groupKeys) {
+    string inputkey = (inputKeys.count(group.first)) ? inputKeys[group.first] : "-";
+    cachefile << "group " << group.first << " " << group.second << " " << inputkey << endl;
+  }
+  for(auto& file: fileHashes) {
+    cachefile << "file " << file.first << " " << file.second.size << " " << file.second.mtime
+	      << " " << file.second.inode << " " << file.second.hash << endl;
+  }
+  cachefile.close();
+  rename(tmpname.c_str(), cachename.c_str());
+}
+
+//// Everything that changes the normalized file goes in here (including
+/// the tree merge mode, compression, the pyramid and the -only/-exclude
+/// patterns if withFilter).  Numbers are written with full precision so
+/// any change in the config changes the key
+string NormCache::getKey(Normer& norm, bool withFilter) {
+  ostringstream keystream;
+  keystream << setprecision(17);
+  keystream << getInputKey(norm) << " " << norm.lumi << " " << norm.treeMode << " " << norm.compression;
+  if(withFilter && norm.filter) keystream << norm.filter->getSignature();
+  if(norm.pyramid) keystream << " pyramid";
+  for(int i = 0; i < norm.input.size(); i++) {
+    keystream << " | " << norm.xsec.at(i) << " " << norm.skim.at(i) << " " << norm.SF.at(i);
+  }
+  return hashString(keystream.str());
+}
+
+//// Just the input files (and type), without any of the numbers used to
+/// scale them.  The format version is in here so it is in both keys (the
+/// sidecar is made by the merge too)
+string NormCache::getInputKey(Normer& norm) {
+  ostringstream keystream;
+  keystream << "v" << formatVersion << " " << norm.type << " " << norm.isData;
+  for(int i = 0; i < norm.input.size(); i++) {
+    keystream << " | " << norm.input.at(i) << " " << hashFile(norm.input.at(i));
+  }
+  return hashString(keystream.str());
+}
+
+string NormCache::hashString(const string& keystring) {
+  uint64_t hash = 14695981039346656037ULL;
+  for(auto c: keystring) {
+    hash ^= (unsigned char)c;
+    hash *= 1099511628211ULL;
+  }
+  return toHex(hash);
+}
+
+//// Hash of the contents of a file.  Reads the file 8 bytes at a time
+/// (FNV style mixing), which is much faster than going byte by byte.
+/// Remembers the hash, so unless the file is touched it's only read once
+string NormCache::hashFile(const string& filename) {
+  struct stat attr;
+  if(stat(filename.c_str(), &attr) != 0) return "missing";
+
+  auto found = fileHashes.find(filename);
+  if(found != fileHashes.end() && found->second.size == attr.st_size &&
+     found->second.mtime == attr.st_mtime && found->second.inode == attr.st_ino) {
+    return found->second.hash;
+  }
+
+  ifstream infile(filename, ios::binary);
+  const size_t bufsize = 1 << 20;
+  vector<char> buffer(bufsize);
+  uint64_t hash = 14695981039346656037ULL;
+  while(infile) {
+    infile.read(buffer.data(), bufsize);
+    size_t nread = infile.gcount();
+    size_t nwords = nread / 8;
+    const char* data = buffer.data();
+    for(size_t i = 0; i < nwords; i++) {
+      uint64_t word;
+      memcpy(&word, data + 8*i, 8);
+      hash = (hash ^ word) * 1099511628211ULL;
+      hash ^= hash >> 29;
+    }
+    for(size_t i = 8*nwords; i < nread; i++) {
+      hash = (hash ^ (unsigned char)data[i]) * 1099511628211ULL;
+    }
+  }
+  infile.close();
+
+  FileHash& filehash = fileHashes[filename];
+  filehash.size = attr.st_size;
+  filehash.mtime = attr.st_mtime;
+  filehash.inode = attr.st_ino;
+  filehash.hash = toHex(hash);
+  changed = true;
+  return filehash.hash;
+}
+
+string NormCache::toHex(uint64_t value) {
+  ostringstream hexstream;
+  hexstream << hex << setw(16) << setfill('0') << value;
+  return hexstream.str();
+}
@@ -0,0 +1,84 @@
+//////////////////////////////
+//// NORMCACHE CLASS /////////
+//////////////////////////////
+
+/*
+
+Keeps track of which normalized files are still good, so only the
+groups that changed get merged again.
+
+Every output group gets a key made from everything that goes into
+its normalized file: the path, size and content hash of each input
+file, plus the xsec, skim and SF of each input and the luminosity.
+If the key is the same as the one saved the last time the group was
+made (and the file is still there), it doesn't need to be remade.
+Files made with -only/-exclude only have part of the histograms, so
+the patterns go in their key (a full file is still good for them).
+
+The keys also have formatVersion, which has to go up whenever the way
+the normalized files are made (MergeRootfile and what it writes)
+changes, so files made by an older version are all remade once.
+
+Hashing big input files is slow, so the content hash of each file is
+saved too, along with its size, mtime and inode.  A file is only read
+again if one of those changes.
+
+With deferred scaling, a second key with only the input files is kept.
+If that one still matches, the group can be rescaled from its sidecar
+file (the unscaled histogram of each input) without opening the inputs.
+
+Everything is saved in a text file (.normcache by default).
+
+ */
+
+#ifndef _NORMCACHE_H_
+#define _NORMCACHE_H_
+
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+
+#include "Normalizer.h"
+
+using namespace std;
+
+class NormCache {
+ public:
+  NormCache(string cachename=".normcache");
+
+  bool isCurrent(Normer&);
+  bool canRescale(Normer&);
+  void update(Normer&);
+  void save();
+  bool hasChanges() const {return changed;}
+
+  string getKey(Normer&, bool withFilter=true);
+  string getInputKey(Normer&);
+  static string hashString(const string&);
+  string hashFile(const string&);
+  static string toHex(uint64_t);
+
+  static const int formatVersion = 1;   //// bump when the normalized files come out different
+
+ private:
+  struct FileHash {
+    long long size, mtime, inode;
+    string hash;
+  };
+
+  string cachename;
+  map<string, string> groupKeys, inputKeys;
+  map<string, FileHash> fileHashes;
+  bool changed = false;   //// anything new since it was read (update, hashFile)
+};
+
+#endif
@@ -2,6 +2,8 @@
 
 using namespace std;
 
+const string Normer::pyramidDir = "__pyramid";
+
 Normer::Normer() {
   
 }
@@ -52,13 +54,8 @@ Normer::~Normer() {
 /// the adding of files when read in from the config file
 void Normer::setValues(vector<string> values) {
   input.push_back(values[0]);
-  string mod_outfile = values[1];
-  while(mod_outfile.find("#") != string::npos) {
-    mod_outfile.erase(mod_outfile.find("#"), 1);
-  }
-
 
-  use = min(shouldAdd(values[0], mod_outfile),use);
+  use = min(shouldAdd(values[0]),use);
   normFactor.push_back(1.);
 
   if(values.size() == 6) {
@@ -75,23 +72,18 @@ void Normer::setValues(vector<string> values) {
   }
 }
 
-//// Has several return cases
-//// 2: output file already exists and is as new as the input files
-////    meaning remaking it is a waste of time
-//// 1: Output file doesn't exist, so will make it OR the input file
-////    is newer than the output file (needs to be remade)
+//// Has two return cases
+//// 1: Input file exists.  Whether the output needs to be remade is
+////    decided later by the NormCache (content hash of the inputs and
+////    the xsec, skim, SF and lumi values), which sets use to 2 if not
 //// 0: Input file doesn't exist, there is an error!
 
 ///// Once done for all files that need to added together, take the minimum
-/// of this number to find out if the file needs to be made, namely, if one
-/// value is 0, theres an error and abort.  If one file is newer than the 
-/// output file (1), readd them.  If all are older than the output file, no need
-/// to remake it (all 2)
-int Normer::shouldAdd(string infile, string globalFile) {
+/// of this number to find out if the file can be made, namely, if one
+/// value is 0, theres an error and abort.
+int Normer::shouldAdd(string infile) {
   struct stat buffer;
   if(stat(infile.c_str(), &buffer) != 0) return 0;
-  else if(stat(globalFile.c_str(), &buffer) != 0) return 1;
-  else if(getModTime(globalFile.c_str()) > getModTime(infile.c_str())) return 2;
   else return 1;
 
 }
@@ -101,20 +93,247 @@ void Normer::setLumi(double lumi) {
 }
 
 
-//// Helper function for shouldAdd (finds mod time of file)
-int Normer::getModTime(const char *path) {
-  struct stat attr;
-  stat(path, &attr);
-  char date[100] = {0};
-  strftime(date, 100, "%s", localtime(&attr.st_mtime));
-  return atoi(date);
+//// name of the normalized file (output name without the #'s used for latex)
+string Normer::getFilename() {
+  string filename = output;
+  while(filename.find("#") != string::npos) {
+    filename.erase(filename.find("#"), 1);
+  }
+  return filename;
+}
+
+//// total size in bytes of all of the input files.  Used to decide which
+/// groups to start first when normalizing in parallel (biggest first)
+Long64_t Normer::getInputSize() {
+  Long64_t total = 0;
+  struct stat buffer;
+  for(vector<string>::iterator name = input.begin(); name != input.end(); ++name) {
+    if(stat(name->c_str(), &buffer) == 0) total += buffer.st_size;
+  }
+  return total;
+}
+
+//// Makes the normalized file for this group (or opens the old one if it is
+/// still good) and stores it in normedFile.  Also times how long it took so
+/// it can be reported.  Doesn't touch anything outside of this Normer, so
+/// different groups can be normalized on different threads
+void Normer::Normalize() {
+  auto start = chrono::steady_clock::now();
+  string filename = getFilename();
+
+  //// the sidecar has a directory for each input file with its unscaled
+  /// histograms, so merging those with the current numbers is the same
+  /// as merging the real inputs.  One that can't be read (cut short,
+  /// broken) means merging the inputs again
+  if(use == 1 && rescale) {
+    parts = TFile::Open(getSidecarName().c_str());
+    FileList = new TList();
+    for(int i = 0; parts && !parts->IsZombie() && i < input.size(); i++) {
+      TDirectory* partdir = parts->GetDirectory(("input" + to_string(i)).c_str());
+      if(!partdir) break;
+      FileList->Add(partdir);
+    }
+    if(FileList->GetSize() != input.size()) {
+      cout << "could not read " << getSidecarName() << ", merging the input files again" << endl;
+      if(parts) parts->Close();
+      delete parts;
+      parts = NULL;
+      delete FileList;
+      rescale = false;
+    }
+  }
+
+  if(use == 1 && rescale) {
+    normedFile = new TFile(filename.c_str(), "RECREATE");
+    if(compression >= 0) normedFile->SetCompressionSettings(compression);
+    summary = new SummaryIndex();
+    MergeRootfile(normedFile);
+
+    //// its directories were the inputs, so they go out of the list too
+    FileList->Clear();
+    parts->Close();
+    delete parts;
+    parts = NULL;
+  } else if(use == 1) {
+    FileList = new TList();
+    for(vector<string>::iterator name = input.begin(); name != input.end(); ++name) {
+      FileList->Add(TFile::Open(name->c_str()));
+    }
+
+    //// a filtered run only merges part of the file, so the sidecar
+    /// (which has to be able to rebuild all of it) is left alone
+    if(deferScale && !isFiltered()) {
+      sidecar = new TFile(getSidecarName().c_str(), "RECREATE");
+      if(compression >= 0) sidecar->SetCompressionSettings(compression);
+      for(int i = 0; i < input.size(); i++) sidecar->mkdir(("input" + to_string(i)).c_str());
+    }
+
+    normedFile = new TFile(filename.c_str(), "RECREATE");
+    if(compression >= 0) normedFile->SetCompressionSettings(compression);
+    summary = new SummaryIndex();
+    MergeRootfile(normedFile);
+
+    if(sidecar) {
+      sidecar->Close();
+      delete sidecar;
+      sidecar = NULL;
+      sidecarDirs.clear();
+    }
+  } else if(use == 2) {
+    normedFile = new TFile(filename.c_str());
+    summary = new SummaryIndex();
+    bool hasSummary = summary->read(getSummaryName(), normedFile->GetUUID().AsString());
+    if(store) {
+      KeyIndex index(normedFile);
+      fillStore(index, (hasSummary || isFiltered()) ? NULL : summary);
+    }
+    //// files from before there were summaries get one the first time
+    /// all of their histograms are read anyway (store, no filter)
+    if(!hasSummary && store && !isFiltered()) summary->write(getSummaryName(), normedFile->GetUUID().AsString());
+    else if(!hasSummary) {
+      delete summary;
+      summary = NULL;
+    }
+  }
+
+  if(use == 1) summary->write(getSummaryName(), normedFile->GetUUID().AsString());
+
+  normTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+//// Sidecar file with the unscaled histograms of each input.  Same name as
+/// the normalized file with .parts.root at the end instead of .root
+string Normer::getSidecarName() {
+  string filename = getFilename();
+  if(filename.size() > 5 && filename.substr(filename.size()-5) == ".root") filename.erase(filename.size()-5);
+  return filename + ".parts.root";
+}
+
+//// Summary of every histogram in the normalized file (SummaryIndex),
+/// .summary instead of .root
+string Normer::getSummaryName() {
+  string filename = getFilename();
+  if(filename.size() > 5 && filename.substr(filename.size()-5) == ".root") filename.erase(filename.size()-5);
+  return filename + ".summary";
+}
+
+//// Absolute path of an input file, so a virtual tree (TChain) in the
+/// normalized file still finds it when read from somewhere else
+string Normer::getFullPath(const string& filename) {
+  char* fullpath = realpath(filename.c_str(), NULL);
+  if(!fullpath) return filename;
+  string result = fullpath;
+  free(fullpath);
+  return result;
+}
+
+//// Where level x<factor> of the histograms in dirpath go:
+/// __pyramid/x<factor>/<dirpath>
+string Normer::getPyramidPath(const string& dirpath, int factor) {
+  return pyramidDir + "/x" + to_string(factor) + ((dirpath == "") ? "" : "/" + dirpath);
+}
+
+//// Directory path (from getPyramidPath) in file, made when it's first
+/// needed.  Only used by the thread writing the normalized file
+TDirectory* Normer::getPyramidDir(TFile* file, const string& path) {
+  auto found = pyramidDirs.find(path);
+  if(found != pyramidDirs.end()) return found->second;
+
+  TDirectory* dir = file->GetDirectory(path.c_str());
+  if(!dir) {
+    size_t slash = path.rfind("/");
+    TDirectory* mother = (slash == string::npos) ? file : getPyramidDir(file, path.substr(0, slash));
+    dir = mother->mkdir((slash == string::npos) ? path.c_str() : path.substr(slash+1).c_str());
+  }
+  pyramidDirs[path] = dir;
+  return dir;
+}
+
+//// Writes hist rebinned by 2, 4 and 8 (TH1::Rebin, same as the plotter
+/// would do with RebinFactor) into the pyramid of file.  Levels with
+/// less than one bin are left out
+void Normer::writePyramid(TFile* file, const string& dirpath, const string& name, TH1* hist) {
+  if(hist->GetDimension() != 1) return;
+  for(int factor = 2; factor <= 8; factor *= 2) {
+    if(hist->GetXaxis()->GetNbins() < factor) break;
+    TH1* level = hist->Rebin(factor, (name + "_x" + to_string(factor)).c_str());
+    getPyramidDir(file, getPyramidPath(dirpath, factor))->cd();
+    level->Write(name.c_str());
+    if(store) store->add(getPyramidPath(dirpath, factor), name, level);
+    if(summary) summary->add(getPyramidPath(dirpath, factor), name, level);
+    delete level;
+  }
+}
+
+//// Directory in the sidecar for input number spot and the path in the
+/// file.  Makes the directories as they are needed
+TDirectory* Normer::getSidecarDir(int spot, const string& path) {
+  string dirname = "input" + to_string(spot) + ((path == "") ? "" : "/" + path);
+  auto found = sidecarDirs.find(dirname);
+  if(found != sidecarDirs.end()) return found->second;
+
+  TDirectory* dir = sidecar->GetDirectory(dirname.c_str());
+  if(!dir) {
+    size_t slash = path.rfind("/");
+    TDirectory* mother = (slash == string::npos) ? getSidecarDir(spot, "") : getSidecarDir(spot, path.substr(0, slash));
+    dir = mother->mkdir((slash == string::npos) ? path.c_str() : path.substr(slash+1).c_str());
+  }
+  sidecarDirs[dirname] = dir;
+  return dir;
+}
+
+//// Puts all of the histograms of an already normalized file into the
+/// store (and newSummary if there is one).  The whole file is read in
+/// offset order (ReadPlanner), not directory by directory.  With a
+/// filter, only the histograms it keeps (and their pyramid levels) and
+/// the Events ones are read
+void Normer::fillStore(KeyIndex& index, SummaryIndex* newSummary) {
+  vector<pair<string, string>> hists;
+  listHists(index, "", hists);
+
+  vector<TKey*> keys;
+  for(auto& hist: hists) keys.push_back(index.find(hist.first, hist.second));
+  ReadPlanner::read(keys, [&](int k, TObject* object) {
+      TH1* hist = (TH1*)object;
+      if(!hist) {
+	cout << "could not read " << hists.at(k).first << "/" << hists.at(k).second << " from " << getFilename() << ", leaving it out of the store" << endl;
+	return;
+      }
+      store->add(hists.at(k).first, hists.at(k).second, hist);
+      if(newSummary) newSummary->add(hists.at(k).first, hists.at(k).second, hist);
+      delete hist;
+    });
+}
 
+//// (path, name) of every histogram in path and its subdirectories that
+/// the filter keeps
+void Normer::listHists(KeyIndex& index, const string& path, vector<pair<string, string>>& hists) {
+  string basepath = getBasePath(path);
+  for(auto& name: index.getNames(path)) {
+    if(index.isDirectory(path, name)) {
+      listHists(index, (path == "") ? name : path + "/" + name, hists);
+      continue;
+    }
+    TKey* key = index.find(path, name);
+    TClass* cl = TClass::GetClass(key->GetClassName());
+    if(!cl || !cl->InheritsFrom(TH1::Class())) continue;
+    if(!isFiltered() || name == "Events" || filter->keep(basepath, name)) hists.push_back(make_pair(path, name));
+  }
 }
 
+//// Directory a pyramid level was made from (__pyramid/x<factor>/<dirpath>
+/// gives dirpath), any other path as it is
+string Normer::getBasePath(const string& path) {
+  string prefix = pyramidDir + "/x";
+  if(path.compare(0, prefix.size(), prefix) != 0) return path;
+  size_t slash = path.find('/', prefix.size());
+  return (slash == string::npos) ? "" : path.substr(slash + 1);
+}
 
 //// prints out info about input files
 void Normer::print() {
   cout << " =========== " << output << " =========== " << endl;
+  if(rescale) cout << "(rescaled from " << getSidecarName() << ")" << endl;
   for(int i = 0; i < input.size(); ++i) {
     cout << input.at(i) << endl;
   }
@@ -144,109 +363,400 @@ double Normer::getBayesError(double pass, double full) {
 
 
 
-///// Ripped hadd function.  Adds all the histograms together 
-/// while normalizing them
+//// Builds the key index for every source file.  Done once at the top of
+/// MergeRootfile so every directory after that is just a hash lookup
+void Normer::buildIndexes() {
+  clearIndexes();
+  TDirectory* source = (TDirectory*)FileList->First();
+  while(source) {
+    indexes.push_back(new KeyIndex(source));
+    //// one lock per file, the sources are all in one file when rescaling
+    mutex*& lock = fileLocks[source->GetFile()];
+    if(!lock) lock = new mutex();
+    inputLocks.push_back(lock);
+    source = (TDirectory*)FileList->After(source);
+  }
+}
+
+void Normer::clearIndexes() {
+  for(auto index: indexes) delete index;
+  for(auto& lock: fileLocks) delete lock.second;
+  indexes.clear();
+  inputLocks.clear();
+  fileLocks.clear();
+}
+
+//// All the key names in a directory over every source file.  Goes in the
+/// order of the first file, then anything new in the second file, and so on,
+/// so histograms that aren't in the first file still get merged
+vector<string> Normer::getKeyUnion(const string& path) {
+  vector<string> allnames;
+  unordered_set<string> seen;
+  for(auto index: indexes) {
+    for(auto& name: index->getNames(path)) {
+      if(seen.insert(name).second) allnames.push_back(name);
+    }
+  }
+  return allnames;
+}
+
+//// Scale for the histograms of input file number spot.  factors is the
+/// 1/Events of each input for the directory (see planMerge)
+double Normer::getScale(int spot, const vector<double>& factors) {
+  double scale = (isData || xsec.at(spot) < 0) ? 1.0 : factors.at(spot) * xsec.at(spot)* lumi* skim.at(spot);
+  return scale * SF.at(spot);
+}
+
+//// Events histogram gets a bayesian error on the pass bin.  Everything else
+/// has NaN errors or errors bigger than the bin set to the bin content
+void Normer::sanitizeErrors(TH1* hist) {
+  if(strcmp(hist->GetTitle(),"Events") == 0) {
+    hist->SetBinError(2,getBayesError(hist->GetBinContent(2), hist->GetBinContent(1)));
+  } else {
+    for(int i = 1; i <= hist->GetXaxis()->GetNbins(); i++) {
+      if(hist->GetBinError(i) != hist->GetBinError(i) || hist->GetBinError(i) > hist->GetBinContent(i)) {
+	hist->SetBinError(i, abs(hist->GetBinContent(i)));
+      }
+    }
+  }
+}
+
+//// First input file (number put in first) that has the key
+TKey* Normer::findFirst(const string& dirpath, const string& name, int& first) {
+  TKey* key = NULL;
+  for(first = 0; first < indexes.size(); first++) {
+    if( (key = indexes.at(first)->find(dirpath, name)) ) break;
+  }
+  return key;
+}
+
+//// Reads the histograms in names from input spot (NULL for the ones it
+/// doesn't have) in one pass over the file in offset order (ReadPlanner),
+/// and saves the unscaled copies if doing deferred scaling.  Errors are
+/// fixed later (scaleHist/addHist).  Safe to call from any thread, only
+/// one thread at a time reads each input
+vector<TH1*> Normer::readInputs(int spot, const string& dirpath, const vector<string>& names) {
+  vector<TKey*> keys;
+  for(auto& name: names) keys.push_back(indexes.at(spot)->find(dirpath, name));
+
+  vector<TH1*> hists(names.size(), (TH1*)NULL);
+  {
+    lock_guard<mutex> lock(*inputLocks.at(spot));
+    ReadPlanner::read(keys, [&](int k, TObject* object) {hists.at(k) = (TH1*)object;});
+  }
+
+  for(int k = 0; k < names.size(); k++) {
+    if(!hists.at(k)) continue;
+    hists.at(k)->Sumw2();
+
+    //// unscaled copy for rescaling later (deferred scaling).  Errors get
+    /// fixed again when it is merged, so it doesn't matter they aren't yet
+    if(sidecar) {
+      lock_guard<mutex> lock(sidecarLock);
+      getSidecarDir(spot, dirpath)->cd();
+      hists.at(k)->Write( names.at(k).c_str() );
+    }
+  }
+  return hists;
+}
+
+//// The fused kernels work on TH1D and TH1F with sumw2.  Events keeps
+/// the old path because of its bayesian error
+bool Normer::canFuse(TH1* hist) {
+  return useKernel && (hist->IsA() == TH1D::Class() || hist->IsA() == TH1F::Class())
+    && hist->GetSumw2N() > 0 && strcmp(hist->GetTitle(),"Events") != 0;
+}
+
+//// Fixes the errors (if sanitize) and scales the histogram.  Same as
+/// sanitizeErrors + Scale, but done in one pass over the bin arrays
+void Normer::scaleHist(TH1* hist, double scale, bool sanitize) {
+  if(!canFuse(hist)) {
+    if(sanitize) sanitizeErrors(hist);
+    hist->Scale(scale);
+    return;
+  }
+
+  double stats[13] = {0};  //// TH1::kNstat
+  hist->GetStats(stats);
+  int nbins = hist->GetXaxis()->GetNbins();
+  double* sumw2 = hist->GetSumw2()->GetArray();
+  if(hist->IsA() == TH1D::Class()) fusedScale(((TH1D*)hist)->GetArray(), sumw2, nbins, scale, sanitize);
+  else fusedScale(((TH1F*)hist)->GetArray(), sumw2, nbins, scale, sanitize);
+
+  for(int i = 0; i < 13; i++) stats[i] *= (i == 1) ? scale*scale : scale;
+  hist->PutStats(stats);
+}
+
+//// Same variable bin edges (or both fixed bins).  Same range and number
+/// of bins isn't enough for variable bins
+bool Normer::sameEdges(const TAxis* a, const TAxis* b) {
+  const TArrayD* abins = a->GetXbins();
+  const TArrayD* bbins = b->GetXbins();
+  if(abins->GetSize() != bbins->GetSize()) return false;
+  for(int i = 0; i < abins->GetSize(); i++) {
+    if(abins->GetArray()[i] != bbins->GetArray()[i]) return false;
+  }
+  return true;
+}
+
+//// Fixes the errors of h2 (if sanitize) and does h1->Add(h2, scale) in one
+/// pass.  Stats and entries are updated the same way TH1::Add does it.
+/// Anything the kernel can't do (different types or binning) goes to Add
+void Normer::addHist(TH1* h1, TH1* h2, double scale, bool sanitize) {
+  if(!canFuse(h1) || !canFuse(h2) || h1->IsA() != h2->IsA() || h1->GetNcells() != h2->GetNcells()
+     || h1->GetXaxis()->GetXmin() != h2->GetXaxis()->GetXmin() || h1->GetXaxis()->GetXmax() != h2->GetXaxis()->GetXmax()
+     || !sameEdges(h1->GetXaxis(), h2->GetXaxis())) {
+    if(sanitize) sanitizeErrors(h2);
+    h1->Add(h2, scale);
+    return;
+  }
+
+  double s1[13] = {0}, s2[13] = {0};  //// TH1::kNstat
+  h1->GetStats(s1);
+  h2->GetStats(s2);
+  double entries = abs(h1->GetEntries() + scale * h2->GetEntries());
+
+  int nbins = h1->GetXaxis()->GetNbins();
+  double* w2dst = h1->GetSumw2()->GetArray();
+  double* w2src = h2->GetSumw2()->GetArray();
+  if(h1->IsA() == TH1D::Class()) fusedAccumulate(((TH1D*)h1)->GetArray(), w2dst, ((TH1D*)h2)->GetArray(), w2src, nbins, scale, sanitize);
+  else fusedAccumulate(((TH1F*)h1)->GetArray(), w2dst, ((TH1F*)h2)->GetArray(), w2src, nbins, scale, sanitize);
+
+  if(scale < 0) {
+    h1->ResetStats();
+  } else {
+    for(int i = 0; i < 13; i++) s1[i] += ((i == 1) ? scale*scale : scale) * s2[i];
+    h1->PutStats(s1);
+    h1->SetEntries(entries);
+  }
+}
+
+//// The histograms of the directory and the first input that has each
+vector<string> Normer::getHistNames(const MergeDir& dir, vector<int>& firsts) {
+  vector<string> histnames;
+  for(auto& name: dir.names) {
+    int first;
+    TKey* key = findFirst(dir.path, name, first);
+    TClass* cl = TClass::GetClass(key->GetClassName());
+    if(!cl || !cl->InheritsFrom(TH1::Class())) continue;
+    histnames.push_back(name);
+    firsts.push_back(first);
+  }
+  return histnames;
+}
+
+//// Adds up the histograms of the directory over all of the inputs, one
+/// input after the other.  Each histogram is still added up in input
+/// order, the inputs are just read a whole directory at a time
+unordered_map<string, TH1*> Normer::mergeHists(const MergeDir& dir) {
+  vector<int> firsts;
+  vector<string> histnames = getHistNames(dir, firsts);
+  vector<TH1*> sums(histnames.size(), (TH1*)NULL);
+
+  for(int spot = 0; spot < indexes.size(); spot++) {
+    vector<TH1*> hists = readInputs(spot, dir.path, histnames);
+    for(int k = 0; k < histnames.size(); k++) {
+      TH1* h2 = hists.at(k);
+      if(!h2) continue;
+
+      if(sums.at(k) == NULL) {
+	sums.at(k) = h2;
+	scaleHist(h2, (isData) ? 1.0 : getScale(spot, dir.factors), true);
+      } else {
+	addHist(sums.at(k), h2, getScale(spot, dir.factors), true);
+	delete h2;
+      }
+    }
+  }
+
+  unordered_map<string, TH1*> merged;
+  for(int k = 0; k < histnames.size(); k++) merged[histnames.at(k)] = sums.at(k);
+  return merged;
+}
+
+//// Same thing as mergeHists, but each input file is read and scaled by
+/// its own worker, then the scaled pieces of each histogram are added in
+/// pairs ((0+1)+(2+3))+... always in the same order, so the result is
+/// exactly the same no matter how many workers there are
+unordered_map<string, TH1*> Normer::mergeHistsParallel(const MergeDir& dir) {
+  vector<int> firsts;
+  vector<string> histnames = getHistNames(dir, firsts);
+
+  int nspots = indexes.size();
+  vector<vector<TH1*>> parts(histnames.size(), vector<TH1*>(nspots, (TH1*)NULL));
+
+  WorkerPool pool(inputWorkers);
+  pool.run(nspots, [&](int spot) {
+      vector<TH1*> hists = readInputs(spot, dir.path, histnames);
+      for(int k = 0; k < histnames.size(); k++) {
+	TH1* hist = hists.at(k);
+	if(!hist) continue;
+	scaleHist(hist, (isData && spot == firsts.at(k)) ? 1.0 : getScale(spot, dir.factors), true);
+	parts.at(k).at(spot) = hist;
+      }
+    });
+
+  pool.run(histnames.size(), [&](int k) {
+      vector<TH1*> level;
+      for(auto hist: parts.at(k)) {
+	if(hist) level.push_back(hist);
+      }
+      while(level.size() > 1) {
+	vector<TH1*> next;
+	for(int i = 0; i+1 < level.size(); i += 2) {
+	  addHist(level.at(i), level.at(i+1), 1.0, false);
+	  delete level.at(i+1);
+	  next.push_back(level.at(i));
+	}
+	if(level.size() % 2 == 1) next.push_back(level.back());
+	level = next;
+      }
+      parts.at(k).at(0) = level.at(0);
+    });
+
+  unordered_map<string, TH1*> merged;
+  for(int k = 0; k < histnames.size(); k++) merged[histnames.at(k)] = parts.at(k).at(0);
+  return merged;
+}
+
+///// Ripped hadd function.  Adds all the histograms together
+/// while normalizing them.
+///
+/// The directory tree is planned first (planMerge makes the output
+/// directories), then each directory is a job for dirWorkers threads that
+/// read and add up its histograms (mergeDirectory).  The merged histograms
+/// and trees are written by this thread, one directory at a time in the
+/// planned order (writeDirectory), since a TFile can only be written by
+/// one thread
 void Normer::MergeRootfile( TDirectory *target) {
 
-  TList* sourcelist = FileList;
   TString path( (char*)strstr( target->GetPath(), ":" ) );
   path.Remove( 0, 2 );
+  string dirpath = path.Data();
+
+  buildIndexes();
 
-  TFile *first_source = (TFile*)sourcelist->First();
-  first_source->cd( path );
-  TDirectory *current_sourcedir = gDirectory;
   //gain time, do not add the objects in the list in memory
   Bool_t status = TH1::AddDirectoryStatus();
   TH1::AddDirectory(kFALSE);
 
+  vector<MergeDir> plan;
+  planMerge(target, dirpath, plan);
 
-  ///try to find events to calculate efficiency
-  TH1D* events;
-  current_sourcedir->GetObject("Events", events);
+  vector<unordered_map<string, TH1*>> merged(plan.size());
+  WorkerPool pool(dirWorkers);
+  pool.runOrdered(plan.size(), [&](int d) {
+      merged.at(d) = mergeDirectory(plan.at(d));
+    }, [&](int d) {
+      writeDirectory(plan.at(d), merged.at(d));
+      merged.at(d).clear();
+    });
+
+  // save modifications to target file
+  for(auto& dir: plan) dir.target->SaveSelf(kTRUE);
+  for(auto& dir: pyramidDirs) dir.second->SaveSelf(kTRUE);
+  pyramidDirs.clear();
+  TH1::AddDirectory(status);
 
-  if(events) {
-    TH1D* efficiency=new TH1D("eff", "eff", 1, 0, 1);
-    // target->cd();
-    // efficiency->Write();
+  clearIndexes();
+}
 
-    first_source->cd( path );
-    int nplot = 0;
+//// Depth first over the union of the input directories, in the same order
+/// the old recursion went.  Makes each output directory and finds the
+/// Events scaling for it.  Directories without an Events histogram keep the
+/// scaling of the directory before them, like before.
+///
+/// With a filter, only the histograms it keeps (and the Events ones) are
+/// merged, and directories with nothing wanted under them aren't made.
+/// Those are still walked (target NULL) for their Events, so the scaling
+/// of the directories after them doesn't change
+void Normer::planMerge(TDirectory* target, const string& dirpath, vector<MergeDir>& plan) {
+
+  ///try to find events to calculate efficiency
+  for(int nplot = 0; nplot < indexes.size(); nplot++) {
+    TKey* eventkey = indexes.at(nplot)->find(dirpath, "Events");
+    if(!eventkey) continue;
+    TH1* events = (TH1*)eventkey->ReadObj();
     normFactor.at(nplot) = 1.0/events->GetBinContent(1);
-    TFile *nextsource = (TFile*)sourcelist->After( first_source );
-    while( nextsource) {
-      nplot++;
-      nextsource->cd(path);
-      gDirectory->GetObject("Events", events);
-      normFactor.at(nplot) = 1.0/events->GetBinContent(1);
-      nextsource = (TFile*)sourcelist->After( nextsource );
+    delete events;
+  }
+
+  MergeDir dir;
+  dir.target = target;
+  dir.path = dirpath;
+  dir.factors = normFactor;
+  vector<string> allnames = getKeyUnion(dirpath);
+
+  for(auto& name: allnames) {
+    int first;
+    TKey* key = findFirst(dirpath, name, first);
+    TClass* cl = TClass::GetClass(key->GetClassName());
+    string subpath = (dirpath == "") ? name : dirpath + "/" + name;
+    if ( cl && cl->InheritsFrom( TDirectory::Class() ) ) {
+      if(target && (!isFiltered() || hasWanted(subpath))) dir.names.push_back(name);
+    } else if(!isFiltered() || name == "Events" ||
+	      (cl && cl->InheritsFrom( TH1::Class() ) && filter->keep(dirpath, name))) {
+      dir.names.push_back(name);
     }
   }
-  delete events;
+  if(target) plan.push_back(dir);
 
-  // loop over all keys in this directory
-  TChain *globChain = 0;
-  TIter nextkey( current_sourcedir->GetListOfKeys() );
-  TKey *key, *oldkey=0;
-  while ( (key = (TKey*)nextkey())) {
-    //keep only the highest cycle number for each key
-    if (oldkey && !strcmp(oldkey->GetName(),key->GetName())) continue;
+  for(auto& name: allnames) {
+    int first;
+    TKey* key = findFirst(dirpath, name, first);
+    TClass* cl = TClass::GetClass(key->GetClassName());
+    if ( cl && cl->InheritsFrom( TDirectory::Class() ) ) {
+      // create a new subdir of same name and title in the target file
+      TDirectory* newdir = NULL;
+      if(target && find(dir.names.begin(), dir.names.end(), name) != dir.names.end()) {
+	target->cd();
+	newdir = target->mkdir( name.c_str(), key->GetTitle() );
+      }
+      planMerge(newdir, (dirpath == "") ? name : dirpath + "/" + name, plan);
+    }
+  }
+}
 
-    first_source->cd( path );
+//// True if the filter keeps any histogram in this directory or under it
+bool Normer::hasWanted(const string& dirpath) {
+  for(auto& name: getKeyUnion(dirpath)) {
+    int first;
+    TKey* key = findFirst(dirpath, name, first);
+    TClass* cl = TClass::GetClass(key->GetClassName());
+    if ( cl && cl->InheritsFrom( TDirectory::Class() ) ) {
+      if(hasWanted((dirpath == "") ? name : dirpath + "/" + name)) return true;
+    } else if ( cl && cl->InheritsFrom( TH1::Class() ) && name != "Events" && filter->keep(dirpath, name) ) {
+      return true;
+    }
+  }
+  return false;
+}
 
-    TObject *obj = key->ReadObj();
-    if ( obj->IsA()->InheritsFrom( TH1::Class() ) ) {
-      TH1 *h1 = (TH1*)obj;
-      h1->Sumw2();
+//// Adds up all of the histograms of one directory.  With input workers,
+/// they are read and scaled in parallel (one worker per input file)
+unordered_map<string, TH1*> Normer::mergeDirectory(const MergeDir& dir) {
+  if(inputWorkers > 0) return mergeHistsParallel(dir);
+  return mergeHists(dir);
+}
 
-      int spot = 0;
-      double scale1 = (isData || xsec.at(spot) < 0) ? 1.0 : normFactor.at(spot) * xsec.at(spot)* lumi* skim.at(spot);
-      scale1 *= SF.at(spot);
+//// Writes the merged histograms of one directory and merges its trees,
+/// in the order of the keys
+void Normer::writeDirectory(const MergeDir& dir, unordered_map<string, TH1*>& merged) {
+  TList* sourcelist = FileList;
+  TDirectory* target = dir.target;
+  const string& dirpath = dir.path;
 
+  // loop over all keys in this directory (from all of the files)
+  for(auto& name: dir.names) {
 
+    //// first file that has this key.  Used to find out what type it is
+    int first;
+    TKey* key = findFirst(dirpath, name, first);
 
+    TClass* cl = TClass::GetClass(key->GetClassName());
+    if ( cl && cl->InheritsFrom( TH1::Class() ) ) {
+      TH1* h1 = merged[name];
 
-      if(strcmp(h1->GetTitle(),"Events") == 0) {
-      	h1->SetBinError(2,getBayesError(h1->GetBinContent(2), h1->GetBinContent(1)));
-      } else {
-	for(int i = 1; i <= h1->GetXaxis()->GetNbins(); i++) {
-	  if(h1->GetBinError(i) != h1->GetBinError(i) || h1->GetBinError(i) > h1->GetBinContent(i)) {
-	    h1->SetBinError(i, abs(h1->GetBinContent(i)));
-	  }
-	}
-      }
-	
-      if(!isData) h1->Scale(scale1);
-
-      TFile *nextsource = (TFile*)sourcelist->After( first_source );
-      
-      while ( nextsource ) {
-	spot++;
-	nextsource->cd( path );
-	TKey *key2 = (TKey*)gDirectory->GetListOfKeys()->FindObject(h1->GetName());
-	if (key2) {
-	  TH1 *h2 = (TH1*)key2->ReadObj();
-
-	  h2->Sumw2();
-	  // }
-	  double scale = (isData || xsec.at(spot) < 0) ? 1.0 : normFactor.at(spot) * xsec.at(spot)* lumi* skim.at(spot);
-	  scale *= SF.at(spot);
-
-	  if(strcmp(h2->GetTitle(),"Events") == 0) {
-	    h2->SetBinError(2,getBayesError(h2->GetBinContent(2), h2->GetBinContent(1)));
-	  } else {
-	    for(int i = 1; i <= h2->GetXaxis()->GetNbins(); i++) {
-	      if(h2->GetBinError(i) != h2->GetBinError(i) || h2->GetBinError(i) > h2->GetBinContent(i)) {
-		h2->SetBinError(i, abs(h2->GetBinContent(i)));
-	      }
-	    }
-	  }
-
-	  h1->Add( h2, scale);
-	  delete h2;
-	  
-	}
-	nextsource = (TFile*)sourcelist->After( nextsource );
-      }
       ////////////////////////////////////////////////////////////
       ////  To gain back Poisson error, uncomment this line /////
       ////////////////////////////////////////////////////////////
@@ -255,60 +765,52 @@ void Normer::MergeRootfile( TDirectory *target) {
       // 	h1->SetBinError(ibin, sqrt(pow(h1->GetBinError(ibin),2.0) + abs(h1->GetBinContent(ibin))) );
       // }
 
+      // now write the merged histogram to the target file
+      // note that this will just store obj in the current directory level,
+      // which is not persistent until the complete directory itself is stored
+      // by "target->SaveSelf()" below
+      target->cd();
+      h1->Write( name.c_str() );
+      if(store) store->add(dirpath, name, h1);
+      if(summary) summary->add(dirpath, name, h1);
+      if(pyramid) writePyramid(target->GetFile(), dirpath, name, h1);
+      delete h1;
+
     }
-    else if ( obj->IsA()->InheritsFrom( TTree::Class() ) ) {
+    else if ( cl && cl->InheritsFrom( TTree::Class() ) ) {
+      if(treeMode == "skip") continue;
+
+      //// trees can't be rebuilt from the sidecar
+      hasTrees = true;
 
       // loop over all source files create a chain of Trees "globChain"
-      const char* obj_name= obj->GetName();
-
-      globChain = new TChain(obj_name);
-      globChain->Add(first_source->GetName());
-      TFile *nextsource = (TFile*)sourcelist->After( first_source );
-      //      const char* file_name = nextsource->GetName();
-      // cout << "file name  " << file_name << endl;
-      while ( nextsource ) {
-	  
-	globChain->Add(nextsource->GetName());
+      TChain* globChain = new TChain(name.c_str());
+      TFile *nextsource = (TFile*)sourcelist->First();
+      for(int spot = 0; nextsource; spot++) {
+	if(indexes.at(spot)->find(dirpath, name)) {
+	  globChain->Add((treeMode == "virtual") ? getFullPath(nextsource->GetName()).c_str() : nextsource->GetName());
+	}
 	nextsource = (TFile*)sourcelist->After( nextsource );
       }
-	
-    } else if ( obj->IsA()->InheritsFrom( TDirectory::Class() ) ) {
-      // it's a subdirectory
-
-      //      cout << "Found subdirectory " << obj->GetName() << endl;
 
-      // create a new subdir of same name and title in the target file
       target->cd();
-      TDirectory *newdir = target->mkdir( obj->GetName(), obj->GetTitle() );
-
-      // newdir is now the starting point of another round of merging
-      // newdir still knows its depth within the target file via
-      // GetPath(), so we can still figure out where we are in the recursion
-      MergeRootfile( newdir );
-
+      //// virtual: only the chain (list of input files) is written, the
+      /// entries stay in the inputs.  fast: baskets are copied as they are
+      /// instead of being unzipped and zipped again
+      if(treeMode == "virtual") globChain->Write(name.c_str());
+      else if(treeMode == "fast") globChain->Merge(target->GetFile(),0,"keep fast");
+      else globChain->Merge(target->GetFile(),0,"keep");
+      delete globChain;
+
+    } else if ( cl && cl->InheritsFrom( TDirectory::Class() ) ) {
+      //// subdirectory, made by planMerge and merged as its own job
+      continue;
     } else {
 
       // object is of no type that we know or can handle
       cout << "Unknown object type, name: "
-	   << obj->GetName() << " title: " << obj->GetTitle() << endl;
+	   << name << " title: " << key->GetTitle() << endl;
     }
 
-    // now write the merged histogram (which is "in" obj) to the target file
-    // note that this will just store obj in the current directory level,
-    // which is not persistent until the complete directory itself is stored
-    // by "target->Write()" below
-    if ( obj ) {
-      target->cd();
-      if(obj->IsA()->InheritsFrom( TTree::Class() ))
-	globChain->Merge(target->GetFile(),0,"keep");
-      else
-	obj->Write( key->GetName() );
-    }
-
-  } // while ( ( TKey *key = (TKey*)nextkey() ) )
-
-  // save modifications to target file
-  target->SaveSelf(kTRUE);
-  TH1::AddDirectory(status);
+  }
 }
-
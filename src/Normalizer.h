@@ -37,13 +37,25 @@ not as ripped off.
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <map>
+#include <unordered_set>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
 #include "tokenizer.hpp"
+#include "KeyIndex.h"
+#include "HistStore.h"
+#include "WorkerPool.h"
+#include "HistKernels.h"
+#include "PathFilter.h"
+#include "SummaryIndex.h"
+#include "ReadPlanner.h"
 #include <fstream>
 #include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
 #include <array>
 #include <cmath>
+#include <chrono>
 
 using namespace std;
 
@@ -62,18 +74,82 @@ class Normer {
   double lumi;
 
   TList* FileList;
+  TFile* normedFile = NULL;
+  HistStore* store = NULL;
+  SummaryIndex* summary = NULL;   //// numbers of every histogram, see SummaryIndex
   vector<double> normFactor;
   bool isData=false;
   int use=3;
+  bool deferScale=false, rescale=false, hasTrees=false;
+  int inputWorkers = 0;
+  int dirWorkers = 1;
+  bool useKernel = true;
+  int compression = -1;      //// algorithm*100 + level, -1 is ROOT's default
+  string treeMode = "copy";   //// copy, fast, virtual or skip (treemerge in config)
+  const PathFilter* filter = NULL;   //// -only/-exclude, NULL merges everything
+  bool pyramid = false;      //// also write the x2, x4, x8 rebinned levels (-pyramid)
+  double normTime = 0;
 
   
   void setValues(vector<string>);
   void setLumi(double);
-  int shouldAdd(string, string);
-  int getModTime(const char*);
+  int shouldAdd(string);
+  string getFilename();
+  string getSidecarName();
+  string getSummaryName();
+  static string getPyramidPath(const string&, int);
+  static string getBasePath(const string&);
+  static const string pyramidDir;
+  Long64_t getInputSize();
+  void Normalize();
   void MergeRootfile( TDirectory*);
   double getBayesError(double pass, double full);
   void print();
+
+ private:
+  //// One directory of the normalized file: where it goes, 1/Events of
+  /// each input there and the key names over all of the inputs
+  struct MergeDir {
+    TDirectory* target;
+    string path;
+    vector<double> factors;
+    vector<string> names;
+  };
+
+  vector<KeyIndex*> indexes;
+  vector<mutex*> inputLocks;
+  map<TFile*, mutex*> fileLocks;
+  TFile* sidecar = NULL;
+  TFile* parts = NULL;       //// sidecar being rescaled from (rescale)
+  map<string, TDirectory*> sidecarDirs;
+  map<string, TDirectory*> pyramidDirs;
+  mutex sidecarLock;
+
+  void buildIndexes();
+  void clearIndexes();
+  void fillStore(KeyIndex&, SummaryIndex*);
+  void listHists(KeyIndex&, const string&, vector<pair<string, string>>&);
+  string getFullPath(const string&);
+  TDirectory* getSidecarDir(int, const string&);
+  TDirectory* getPyramidDir(TFile*, const string&);
+  void writePyramid(TFile*, const string&, const string&, TH1*);
+  vector<string> getKeyUnion(const string&);
+  double getScale(int, const vector<double>&);
+  TKey* findFirst(const string&, const string&, int&);
+  vector<TH1*> readInputs(int, const string&, const vector<string>&);
+  vector<string> getHistNames(const MergeDir&, vector<int>&);
+  unordered_map<string, TH1*> mergeHists(const MergeDir&);
+  bool canFuse(TH1*);
+  static bool sameEdges(const TAxis*, const TAxis*);
+  void scaleHist(TH1*, double, bool);
+  void addHist(TH1*, TH1*, double, bool);
+  unordered_map<string, TH1*> mergeHistsParallel(const MergeDir&);
+  void planMerge(TDirectory*, const string&, vector<MergeDir>&);
+  bool isFiltered() {return filter && !filter->empty();}
+  bool hasWanted(const string&);
+  unordered_map<string, TH1*> mergeDirectory(const MergeDir&);
+  void writeDirectory(const MergeDir&, unordered_map<string, TH1*>&);
+  void sanitizeErrors(TH1*);
 };
 
 #endif
@@ -0,0 +1,52 @@
+#include "PathFilter.h"
+
+using namespace std;
+
+//// "re:" at the front makes it a regular expression.  A bad one stops
+/// the run, better than silently plotting nothing
+PathFilter::Pattern PathFilter::makePattern(const string& text) {
+  Pattern pattern;
+  pattern.text = text;
+  pattern.isRegex = (text.compare(0, 3, "re:") == 0);
+  if(pattern.isRegex) {
+    try {
+      pattern.re = regex(text.substr(3));
+    } catch(regex_error& error) {
+      cout << "Bad regular expression " << text << " (" << error.what() << "), exiting" << endl;
+      exit(1);
+    }
+  }
+  return pattern;
+}
+
+bool PathFilter::matches(const Pattern& pattern, const string& fullpath) {
+  if(pattern.isRegex) return regex_match(fullpath, pattern.re);
+  return fnmatch(pattern.text.c_str(), fullpath.c_str(), 0) == 0;
+}
+
+//// dirpath is the path of the directory ("" at the top), name the histogram
+bool PathFilter::keep(const string& dirpath, const string& name) const {
+  string fullpath = (dirpath == "") ? name : dirpath + "/" + name;
+
+  bool kept = only.empty();
+  for(auto& pattern: only) {
+    if(!matches(pattern, fullpath)) continue;
+    kept = true;
+    break;
+  }
+  if(!kept) return false;
+
+  for(auto& pattern: exclude) {
+    if(matches(pattern, fullpath)) return false;
+  }
+  return true;
+}
+
+//// Text that changes with any pattern, for the normalized file cache.
+/// Empty if there are no patterns
+string PathFilter::getSignature() const {
+  string signature = "";
+  for(auto& pattern: only) signature += " +" + pattern.text;
+  for(auto& pattern: exclude) signature += " -" + pattern.text;
+  return signature;
+}
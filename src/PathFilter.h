@@ -0,0 +1,54 @@
+//////////////////////////////
+//// PATHFILTER CLASS ////////
+//////////////////////////////
+
+/*
+
+Picks which histograms get merged and plotted (-only and -exclude).
+Every pattern is matched against the whole "dir/histogram" path, the
+same paths KeyIndex uses (top directory is "", so a histogram there is
+just its name).
+
+Patterns are globs (fnmatch, * also goes over /), or regular
+expressions if they start with "re:".  A histogram is kept if it
+matches any -only pattern (or there are none) and no -exclude pattern.
+
+No patterns at all keeps everything, same as before.
+
+ */
+
+#ifndef _PATHFILTER_H_
+#define _PATHFILTER_H_
+
+#include <fnmatch.h>
+
+#include <string>
+#include <vector>
+#include <regex>
+#include <iostream>
+
+using namespace std;
+
+class PathFilter {
+ public:
+  void addOnly(string pattern) {only.push_back(makePattern(pattern));}
+  void addExclude(string pattern) {exclude.push_back(makePattern(pattern));}
+
+  bool empty() const {return only.empty() && exclude.empty();}
+  bool keep(const string&, const string&) const;
+  string getSignature() const;
+
+ private:
+  struct Pattern {
+    string text;
+    bool isRegex;
+    regex re;
+  };
+
+  vector<Pattern> only, exclude;
+
+  static Pattern makePattern(const string&);
+  static bool matches(const Pattern&, const string&);
+};
+
+#endif
@@ -0,0 +1,67 @@
+#include "PlotArena.h"
+
+using namespace std;
+
+thread_local PlotArena::Scratch PlotArena::threadScratch;
+atomic<long> PlotArena::plots(0), PlotArena::allocations(0), PlotArena::maxAllocations(0), PlotArena::scratchAllocations(0);
+
+//// Containers are emptied (without deleting what is in them) first, so
+/// a list or stack never looks at an object that is already gone.  Then
+/// newest first, so things are gone before whatever they were made from
+PlotArena::~PlotArena() {
+  long count = objects.size();
+  plots++;
+  allocations += count;
+  long oldmax = maxAllocations.load();
+  while(count > oldmax && !maxAllocations.compare_exchange_weak(oldmax, count));
+
+  for(auto object: objects) {
+    if(object->InheritsFrom(TCollection::Class())) ((TCollection*)object)->Clear("nodelete");
+    else if(object->InheritsFrom(THStack::Class()) && ((THStack*)object)->GetHists()) ((THStack*)object)->GetHists()->Clear("nodelete");
+  }
+  for(auto object = objects.rbegin(); object != objects.rend(); ++object) delete *object;
+}
+
+//// Array number slot of this thread with at least size entries.  Stays
+/// good until the same slot is asked for again on this thread
+double* PlotArena::scratch(int slot, int size) {
+  vector<vector<double>>& arrays = threadScratch.arrays;
+  if(arrays.size() <= slot) arrays.resize(slot + 1);
+  if(arrays.at(slot).size() < size) {
+    arrays.at(slot).resize(size);
+    scratchAllocations++;
+  }
+  return arrays.at(slot).data();
+}
+
+//// Empty TH1D of this thread with the given title and binning, not in
+/// any directory.  Reused (SetBins and Reset) by the next call
+TH1D* PlotArena::scratchHist(const char* title, int nbins, double xmin, double xmax) {
+  TH1D*& hist = threadScratch.hist;
+  if(!hist) {
+    hist = new TH1D("full", title, nbins, xmin, xmax);
+    hist->SetDirectory(0);
+    scratchAllocations++;
+  } else {
+    hist->SetBins(nbins, xmin, xmax);
+    hist->Reset();
+    hist->SetTitle(title);
+  }
+  return hist;
+}
+
+string PlotArena::getStats() {
+  ostringstream stats;
+  long nplots = plots.load();
+  stats << "Plot arena: " << nplots << " plots, " << fixed << setprecision(1)
+	<< ((nplots > 0) ? (double)allocations.load()/nplots : 0.) << " objects per plot (max "
+	<< maxAllocations.load() << "), " << scratchAllocations.load() << " scratch allocations";
+  return stats.str();
+}
+
+void PlotArena::resetStats() {
+  plots = 0;
+  allocations = 0;
+  maxAllocations = 0;
+  scratchAllocations = 0;
+}
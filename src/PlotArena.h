@@ -0,0 +1,78 @@
+//////////////////////////////
+//// PLOTARENA CLASS /////////
+//////////////////////////////
+
+/*
+
+Owns everything made for one plot (histograms, stacks, lists, graphs,
+legend, text boxes, canvas) and deletes all of it when the plot is
+written, so memory stays the same from the first plot to the last.
+Made in buildPlot (in a worker) and deleted at the end of drawPlot.
+
+Objects given to an arena must not be deleted (or Delete()'d through
+a container) anywhere else, and nothing that already owns an object
+(a histogram's list of functions, a canvas) can have it given to the
+arena too.  Containers (lists, stacks) in the arena only point at their
+objects: they are all emptied before anything is deleted, so deleting
+newest first never has a list looking at something already gone.
+
+Plain arrays (createError) and the summed histogram the binning is
+worked out on are scratch space kept by each thread and reused by the
+next plot, they are only reallocated when a bigger one is needed.
+
+Counts what each plot allocates, printed after the plots with
+getStats() so a change that makes more objects per plot shows up.
+
+ */
+
+#ifndef _PLOTARENA_H_
+#define _PLOTARENA_H_
+
+#include <TObject.h>
+#include <TH1.h>
+#include <TList.h>
+#include <THStack.h>
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <sstream>
+#include <iomanip>
+
+using namespace std;
+
+class PlotArena {
+ public:
+  PlotArena() {}
+  ~PlotArena();
+
+  //// takes ownership of object and hands it back
+  template <typename T>
+  T* own(T* object) {
+    if(object) objects.push_back(object);
+    return object;
+  }
+  int getCount() const {return objects.size();}
+
+  static double* scratch(int, int);
+  static TH1D* scratchHist(const char*, int, double, double);
+  static string getStats();
+  static void resetStats();
+
+ private:
+  PlotArena(const PlotArena&);
+  PlotArena& operator=(const PlotArena&);
+
+  vector<TObject*> objects;
+
+  struct Scratch {
+    vector<vector<double>> arrays;
+    TH1D* hist = NULL;
+    ~Scratch() {delete hist;}
+  };
+  static thread_local Scratch threadScratch;
+
+  static atomic<long> plots, allocations, maxAllocations, scratchAllocations;
+};
+
+#endif
@@ -0,0 +1,196 @@
+//////////////////////////////
+//// PLOT KERNELS ////////////
+//////////////////////////////
+
+/*
+
+Bin loops of the plotting step (Plotter), done on the bin arrays like
+in HistKernels.h (contents and sumw2 with nbins+2 entries, the bin
+edges with nbins+1 entries, edges[i-1] to edges[i] is bin i):
+
+  divideByWidth  contents / width, sumw2 / width^2      (DivideBins)
+  addBins        dst += src, sumw2 too                  (fullHist)
+  divideBins     a/b with TH1::Divide errors            (ratio plot)
+  errorBand      points and errors of the MC band       (createError)
+  ratioWindow    smallest positive / biggest under cut  (setYAxisBot)
+  maxBin         biggest content of bins 1 to nbins     (setYAxisBot)
+
+Every loop is written once on PKVec, which is 4 doubles with AVX, 2 with
+SSE2, and the bins left over (or everything, without either) go through
+the plain loop.  Same math as the TH1 calls they replace, only
+divideByWidth and errorBand can be off in the last bits (sumw2/width^2
+instead of squaring err/width, and the bin centers of fixed bins).
+
+Nothing in here knows about ROOT (see bench/PlotKernelBench.cc).
+
+ */
+
+#ifndef _PLOTKERNELS_H_
+#define _PLOTKERNELS_H_
+
+#include <cmath>
+#include <cfloat>
+
+#include "HistKernels.h"
+
+using namespace std;
+
+#if defined(__AVX__)
+#define PLOTKERNELS_SIMD
+typedef __m256d PKVec;
+const int PKLanes = 4;
+inline PKVec pkLoad(const double* p) {return _mm256_loadu_pd(p);}
+inline void pkStore(double* p, PKVec v) {_mm256_storeu_pd(p, v);}
+inline PKVec pkSet(double x) {return _mm256_set1_pd(x);}
+inline PKVec pkAdd(PKVec a, PKVec b) {return _mm256_add_pd(a, b);}
+inline PKVec pkSub(PKVec a, PKVec b) {return _mm256_sub_pd(a, b);}
+inline PKVec pkMul(PKVec a, PKVec b) {return _mm256_mul_pd(a, b);}
+inline PKVec pkDiv(PKVec a, PKVec b) {return _mm256_div_pd(a, b);}
+inline PKVec pkSqrt(PKVec a) {return _mm256_sqrt_pd(a);}
+inline PKVec pkMax(PKVec a, PKVec b) {return _mm256_max_pd(a, b);}
+inline PKVec pkMin(PKVec a, PKVec b) {return _mm256_min_pd(a, b);}
+inline PKVec pkLess(PKVec a, PKVec b) {return _mm256_cmp_pd(a, b, _CMP_LT_OQ);}
+inline PKVec pkNotEqual(PKVec a, PKVec b) {return _mm256_cmp_pd(a, b, _CMP_NEQ_OQ);}
+//// mask ? a : b
+inline PKVec pkSelect(PKVec mask, PKVec a, PKVec b) {return _mm256_blendv_pd(b, a, mask);}
+#elif defined(__SSE2__)
+#define PLOTKERNELS_SIMD
+typedef __m128d PKVec;
+const int PKLanes = 2;
+inline PKVec pkLoad(const double* p) {return _mm_loadu_pd(p);}
+inline void pkStore(double* p, PKVec v) {_mm_storeu_pd(p, v);}
+inline PKVec pkSet(double x) {return _mm_set1_pd(x);}
+inline PKVec pkAdd(PKVec a, PKVec b) {return _mm_add_pd(a, b);}
+inline PKVec pkSub(PKVec a, PKVec b) {return _mm_sub_pd(a, b);}
+inline PKVec pkMul(PKVec a, PKVec b) {return _mm_mul_pd(a, b);}
+inline PKVec pkDiv(PKVec a, PKVec b) {return _mm_div_pd(a, b);}
+inline PKVec pkSqrt(PKVec a) {return _mm_sqrt_pd(a);}
+inline PKVec pkMax(PKVec a, PKVec b) {return _mm_max_pd(a, b);}
+inline PKVec pkMin(PKVec a, PKVec b) {return _mm_min_pd(a, b);}
+inline PKVec pkLess(PKVec a, PKVec b) {return _mm_cmplt_pd(a, b);}
+inline PKVec pkNotEqual(PKVec a, PKVec b) {return _mm_cmpneq_pd(a, b);}
+inline PKVec pkSelect(PKVec mask, PKVec a, PKVec b) {return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));}
+#endif
+
+#ifdef PLOTKERNELS_SIMD
+//// lanes of v put together with op
+template <typename Op>
+inline double pkReduce(PKVec v, double start, Op op) {
+  double lanes[PKLanes];
+  pkStore(lanes, v);
+  for(int k = 0; k < PKLanes; k++) start = op(start, lanes[k]);
+  return start;
+}
+#endif
+
+//// Bins 1 to nbins divided by their width (errors too)
+inline void divideByWidth(double* w, double* w2, const double* edges, int nbins) {
+  int i = 1;
+#ifdef PLOTKERNELS_SIMD
+  for(; i + PKLanes <= nbins + 1; i += PKLanes) {
+    PKVec width = pkSub(pkLoad(edges + i), pkLoad(edges + i - 1));
+    pkStore(w + i, pkDiv(pkLoad(w + i), width));
+    pkStore(w2 + i, pkDiv(pkLoad(w2 + i), pkMul(width, width)));
+  }
+#endif
+  for(; i <= nbins; i++) {
+    double width = edges[i] - edges[i-1];
+    w[i] /= width;
+    w2[i] /= width*width;
+  }
+}
+
+//// dst->Add(src) on all of the bins.  Same loop as the merge
+inline void addBins(double* dst, double* dstw2, const double* src, const double* srcw2, int nbins) {
+  fusedAccumulate(dst, dstw2, src, srcw2, nbins, 1.0, false);
+}
+
+//// out = a/b on all of the bins, errors like TH1::Divide.  0 (and no
+/// error) where b is 0.  out can be a or b
+inline void divideBins(const double* a, const double* aw2, const double* b, const double* bw2, double* out, double* outw2, int nbins) {
+  int i = 0;
+#ifdef PLOTKERNELS_SIMD
+  PKVec zero = pkSet(0.0);
+  for(; i + PKLanes <= nbins + 2; i += PKLanes) {
+    PKVec va = pkLoad(a + i), vb = pkLoad(b + i);
+    PKVec vb2 = pkMul(vb, vb);
+    PKVec err = pkDiv(pkAdd(pkMul(pkLoad(aw2 + i), vb2), pkMul(pkLoad(bw2 + i), pkMul(va, va))), pkMul(vb2, vb2));
+    PKVec good = pkNotEqual(vb, zero);
+    pkStore(out + i, pkSelect(good, pkDiv(va, vb), zero));
+    pkStore(outw2 + i, pkSelect(good, err, zero));
+  }
+#endif
+  for(; i < nbins + 2; i++) {
+    double va = a[i], vb = b[i];
+    if(vb == 0) {
+      out[i] = outw2[i] = 0;
+      continue;
+    }
+    double va2 = va*va, vb2 = vb*vb;
+    outw2[i] = (aw2[i]*vb2 + bw2[i]*va2)/(vb2*vb2);
+    out[i] = va/vb;
+  }
+}
+
+//// Points of the error band for bins 1 to nbins (index 0 is bin 1).
+/// With ratio, the band is around 1 with the relative errors
+inline void errorBand(const double* w, const double* w2, const double* edges, int nbins, bool ratio,
+		      double* x, double* y, double* ex, double* ey) {
+  int i = 1;
+#ifdef PLOTKERNELS_SIMD
+  PKVec half = pkSet(0.5), one = pkSet(1.0);
+  for(; i + PKLanes <= nbins + 1; i += PKLanes) {
+    PKVec low = pkLoad(edges + i - 1), high = pkLoad(edges + i);
+    PKVec content = pkLoad(w + i), err = pkSqrt(pkLoad(w2 + i));
+    pkStore(x + i - 1, pkMul(half, pkAdd(low, high)));
+    pkStore(ex + i - 1, pkMul(half, pkSub(high, low)));
+    pkStore(y + i - 1, (ratio) ? one : content);
+    pkStore(ey + i - 1, (ratio) ? pkDiv(err, content) : err);
+  }
+#endif
+  for(; i <= nbins; i++) {
+    double err = sqrt(w2[i]);
+    x[i-1] = 0.5*(edges[i-1] + edges[i]);
+    ex[i-1] = 0.5*(edges[i] - edges[i-1]);
+    y[i-1] = (ratio) ? 1.0 : w[i];
+    ey[i-1] = (ratio) ? err/w[i] : err;
+  }
+}
+
+//// Over bins 1 to nbins: high is the biggest content under cut (0 if
+/// none), low the smallest one over 0 (cut if none)
+inline void ratioWindow(const double* w, int nbins, double cut, double& low, double& high) {
+  low = cut;
+  high = 0.0;
+  int i = 1;
+#ifdef PLOTKERNELS_SIMD
+  PKVec vcut = pkSet(cut), zero = pkSet(0.0), vlow = vcut, vhigh = zero;
+  for(; i + PKLanes <= nbins + 1; i += PKLanes) {
+    PKVec v = pkLoad(w + i);
+    vhigh = pkMax(vhigh, pkSelect(pkLess(v, vcut), v, zero));
+    vlow = pkMin(vlow, pkSelect(pkLess(zero, v), v, vcut));
+  }
+  high = pkReduce(vhigh, high, [](double a, double b) {return (b > a) ? b : a;});
+  low = pkReduce(vlow, low, [](double a, double b) {return (b < a) ? b : a;});
+#endif
+  for(; i <= nbins; i++) {
+    double v = w[i];
+    if(v < cut && v > high) high = v;
+    if(v > 0. && v < low) low = v;
+  }
+}
+
+//// Biggest content of bins 1 to nbins (TH1::GetMaximum without a range)
+inline double maxBin(const double* w, int nbins) {
+  double high = -DBL_MAX;
+  int i = 1;
+#ifdef PLOTKERNELS_SIMD
+  PKVec vhigh = pkSet(-DBL_MAX);
+  for(; i + PKLanes <= nbins + 1; i += PKLanes) vhigh = pkMax(pkLoad(w + i), vhigh);
+  high = pkReduce(vhigh, high, [](double a, double b) {return (b > a) ? b : a;});
+#endif
+  for(; i <= nbins; i++) if(w[i] > high) high = w[i];
+  return high;
+}
+
+#endif
@@ -6,14 +6,8 @@
 #include <typeinfo>
 using namespace std;
 
-///// macro to save space.  Tests if name is in latex map, if not, it just uses the name given
-#define turnLatex(x) ((latexer[x] == "") ? x : latexer[x])
-
 const double EPSILON_VALUE = 0.0001;
 
-/////map of latex names.  If want to change how things look, change particle names here
-unordered_map<string, string> Plotter::latexer = { {"GenTau", "#tau"}, {"GenHadTau", "#tau_{h}"}, {"GenMuon", "#mu"}, {"TauJet", "#tau"}, {"Muon", "#mu"}, {"DiMuon", "#mu, #mu"}, {"DiTau", "#tau, #tau"}, {"Tau", "#tau"}, {"DiJet", "jj"}, {"Met", "#slash{E}_{T}"}, {"BJet", "b"}};
-
 template <typename T>
 string to_string_with_precision(const T a_value, const int n = 6);
 
@@ -58,392 +52,864 @@ void Plotter::CreateStack( TDirectory *target, Logfile& logfile) {
 
   TString path( (char*)strstr( target->GetPath(), ":" ) );
   path.Remove( 0, 2 );
+  string dirpath = path.Data();
+
+  //// index all the files once per run.  Everything below is a lookup
+  /// in the index, so gDirectory is never changed
+  if(histIndex == NULL) histIndex = new HistIndex(FileList);
+
+  //// plot workers make histograms and stacks in their own threads
+  if(plotWorkers > 1) ROOT::EnableThreadSafety();
 
-  TFile *firstFile = (TFile*)bglist->First();
-  firstFile->cd( path );
-  TDirectory *current_sourcedir = gDirectory;
   Bool_t status = TH1::AddDirectoryStatus();
   TH1::AddDirectory(kFALSE);
 
 
-  //// Loop to write cutflow to logfile
-  TH1* events;
-  current_sourcedir->GetObject("Events", events);
-
-  if(events) {
-    vector<string> logEff;
-    string totalval = "";
-    logEff.push_back(current_sourcedir->GetName());
-
-    for(int i=0; i < 3; i++) {
-      TFile* nextsource = (TFile*)FileList[i]->First();
-      while ( nextsource ) {
-	nextsource->cd(path);
-	gDirectory->GetObject("Events", events);
-	totalval = to_string_with_precision(events->GetBinContent(2), 1);
-	if(i != 0) totalval += " $\\pm$ " + to_string_with_precision(events->GetBinError(2), 1);
-	logEff.push_back(totalval);
-	nextsource = (TFile*)FileList[i]->After( nextsource );
-      }
+  //// The whole directory tree is planned first (all of the output
+  /// directories are made up front), then every plot in every directory
+  /// is a job for the plot workers.  Workers gather, rebin and make the
+  /// error bands (buildPlot), the canvases and cutflow lines are written
+  /// here one at a time in the planned order (drawPlot, getCutflow), so
+  /// the output is the same for any number of workers and a big directory
+  /// doesn't keep the others waiting
+  vector<PlotItem> plan;
+  planStack(target, dirpath, plan);
+  if(filter) cout << "Filter keeps " << plan.size() << " plots and cutflow lines" << endl;
+
+  //// -shard i/N only renders its part of the plan (target is its shard
+  /// file), -merge-shards only puts the shards together.  -spool takes
+  /// batches of the plan until there are none left (or merges the spool)
+  if(spoolDir != "" || nshards > 0 || plotProcs > 1 || mergeOnly) {
+    if(spoolDir != "" && mergeOnly) mergeSpool(plan, logfile);
+    else if(spoolDir != "") runSpool(plan);
+    else if(nshards > 0) renderShard(target->GetFile(), plan, shard, nshards);
+    else if(mergeOnly) mergeShards(plan, target->GetFile()->GetName(), logfile, false);
+    else renderForked(target, plan, logfile);
+    TH1::AddDirectory(status);
+    return;
+  }
+
+  planReads(plan, 0, plan.size(), 1);
+  vector<PlotPieces*> pieces(plan.size(), (PlotPieces*)NULL);
+  WorkerPool pool(plotWorkers);
+  pool.runOrdered(plan.size(), [&](int k) {
+      const PlotItem& item = plan.at(k);
+      if(item.name != "") pieces.at(k) = buildPlot(item.path, item.name, histIndex->getReference(item.path, item.name));
+    }, [&](int k) {
+      const PlotItem& item = plan.at(k);
+      if(item.name == "") logfile.addLine(getCutflow(item.target, item.path));
+      else if(pieces.at(k)) drawPlot(item.target, pieces.at(k));
+    });
+
+  clearReads();
+
+  cout << PlotArena::getStats() << endl;
+  cout << ReadPlanner::getStats() << endl;
+  if(skippedEmpty > 0) cout << skippedEmpty << " empty plots skipped from the summaries" << endl;
+  TH1::AddDirectory(status);
+}
+
+
+//// Process version of the loop above, for when threads aren't safe (ROOT
+/// graphics lean on gPad, gStyle and gDirectory).  Forks plotProcs workers,
+/// worker n renders shard n of the plan into <output>.shard<n>
+/// (renderShard).  When they are all done, the shards are copied into the
+/// output and logfile in the order of the plan (mergeShards), so
+/// everything ends up the same as with one process
+void Plotter::renderForked(TDirectory* target, const vector<PlotItem>& plan, Logfile& logfile) {
+  string outname = target->GetFile()->GetName();
+  vector<pid_t> children;
+
+  cout.flush();
+  for(int n = 0; n < plotProcs; n++) {
+    pid_t pid = fork();
+    if(pid < 0) {
+      cout << "Could not fork plot worker " << n << ", exiting" << endl;
+      exit(1);
+    } else if(pid == 0) {
+      //// child: never touches the output file.  _exit so nothing the
+      /// parent had open (output file, logfile) gets flushed or closed
+      TFile* shardfile = new TFile(getShardName(outname, n).c_str(), "RECREATE");
+      renderShard(shardfile, plan, n, plotProcs);
+      shardfile->Close();
+      _exit(0);
     }
-    logfile.addLine(logEff);
-    delete events;
+    children.push_back(pid);
   }
-  events = NULL;
-
-
-  // loop over all keys in this directory
-  TIter nextkey( current_sourcedir->GetListOfKeys() );
-  TKey *key, *oldkey=0;
-  while ( (key = (TKey*)nextkey())) {
-
-    //keep only the highest cycle number for each key
-    if (oldkey && !strcmp(oldkey->GetName(),key->GetName())) continue;
-
-    TObject *obj = key->ReadObj();
-    if ( obj->IsA() ==  TH1D::Class() || obj->IsA() ==  TH1F::Class() ) {
-
-      /// h1 is the reference histogram to grab the other histos.
-      /// here we also make the containers for the graphs
-      TH1* readObj = (TH1*)obj;
-      TH1D* error = new TH1D("error", readObj->GetTitle(), readObj->GetXaxis()->GetNbins(), readObj->GetXaxis()->GetXmin(), readObj->GetXaxis()->GetXmax());
-      TH1D* datahist = new TH1D("data", readObj->GetTitle(), readObj->GetXaxis()->GetNbins(), readObj->GetXaxis()->GetXmin(), readObj->GetXaxis()->GetXmax());
-      TList* sigHists = new TList();
-      THStack *hs = new THStack(readObj->GetName(),readObj->GetName());
-
-      /*------------data--------------*/
-
-      //////  This iterates over all the different files in the
-      //// FileList array.  Looks a little dirty, but makes the code compact and
-      //// not messy.  If statements based on array position (ie which type of file)
-      //// tell were to put the histograms.  If adding things, go to respective
-      //// if statement.  Want to make styling more robust here, but will take some
-      //// annoying configuration stuff.  Maybe later
-
-      int nfile = 0;
-
-
-      for(int i = 0; i < 3; i++) {
-	TFile* nextfile = (TFile*)FileList[i]->First();
-	while ( nextfile ) {
-	  nextfile->cd( path );
-	  TKey *key2 = (TKey*)gDirectory->GetListOfKeys()->FindObject(readObj->GetName());
-	  if(key2) {
-	    TH1* h2 = (TH1*)key2->ReadObj();
-     /*------------Data--------------*/
-	    if(i == 0)  datahist->Add(h2);
-	    else if(i == 1) {
-     /*------------background--------------*/
-	      error->Add(h2);
-	      for(int j = 1; j < h2->GetXaxis()->GetNbins()+1; j++) {
-		h2->SetBinError(j, 0);
-	      }
-	      //////style
-	      string title = nextfile->GetTitle();
-	      title = title.substr(0, title.size()-5);
-	      h2->SetTitle(title.c_str());
-	      h2->SetLineColor(color[nfile]);
-	      h2->SetFillStyle(1001);
-	      h2->SetFillColor(color[nfile]);
-
-	      hs->Add(h2);
-	      nfile++;
-	    } else if(i == 2) {
-     /*------------Signal--------------*/
-	      for(int j = 1; j < h2->GetXaxis()->GetNbins()+1; j++) {
-		h2->SetBinError(j, 0);
-	      }
-
-	      //////style
-	      string title = nextfile->GetTitle();
-	      title = title.substr(0, title.size()-5);
-	      h2->SetTitle(title.c_str());
-	      h2->SetLineColor(color[nfile]);
-	      h2->SetLineWidth(3);
-	      h2->SetLineStyle(2);
-
-	      sigHists->Add(h2);
-	      nfile++;
-	    }
 
-	  }
-	  nextfile = (TFile*)FileList[i]->After(nextfile);
-	}
-      }
+  bool failed = false;
+  for(int n = 0; n < plotProcs; n++) {
+    int childStatus;
+    if(waitpid(children.at(n), &childStatus, 0) < 0 || !WIFEXITED(childStatus) || WEXITSTATUS(childStatus) != 0) {
+      cout << "Plot worker " << n << " failed" << endl;
+      failed = true;
+    }
+  }
+  if(failed) exit(1);
+
+  mergeShards(plan, outname, logfile, true);
+}
+
+//// <output>.shard<n>, the file shard n of the plots goes to.  Its cutflow
+/// lines go to the same name with .cutflow at the end
+string Plotter::getShardName(const string& outname, int n) {
+  return outname + ".shard" + to_string(n);
+}
+
+//// Renders item k of the plan for every k % nshards == n.  The canvas of
+/// item k goes in shardfile under the key item<k>, cutflow lines go to
+/// <shardfile>.cutflow as k and the values split by tabs, after a first
+/// line saying which shard it is
+void Plotter::renderShard(TFile* shardfile, const vector<PlotItem>& plan, int n, int nshards) {
+  ofstream cutflows(string(shardfile->GetName()) + ".cutflow");
+  cutflows << "shard " << n << " " << nshards << " " << plan.size() << endl;
+  renderItems(shardfile, plan, n, plan.size(), nshards, cutflows);
+  cutflows.close();
+}
+
+//// Renders items first, first+step, ... up to last into file (canvas of
+/// item k under the key item<k>) and cutflows (k then the values split
+/// by tabs).  Shared by the shards and the spool batches
+void Plotter::renderItems(TFile* file, const vector<PlotItem>& plan, int first, int last, int step, ostream& cutflows) {
+  planReads(plan, first, last, step);
+  for(int k = first; k < last; k += step) {
+    const PlotItem& item = plan.at(k);
+    if(item.name == "") {
+      cutflows << k;
+      for(auto& value: getCutflow(item.target, item.path)) cutflows << "\t" << value;
+      cutflows << endl;
+    } else {
+      PlotPieces* pieces = buildPlot(item.path, item.name, histIndex->getReference(item.path, item.name));
+      if(pieces) drawPlot(file, pieces, "item" + to_string(k));
+    }
+  }
+  clearReads();
+}
+
+//// Reads the "k\tvalue\tvalue..." lines written by renderItems
+void Plotter::readCutflows(istream& cutflowfile, map<int, vector<string>>& cutflows) {
+  string line;
+  while(getline(cutflowfile, line)) {
+    istringstream tokens(line);
+    string value;
+    getline(tokens, value, '\t');
+    int k = stoi(value);
+    while(getline(tokens, value, '\t')) cutflows[k].push_back(value);
+  }
+}
+
+//// Copies the canvases and cutflow lines of all of the shards of outname
+/// into the output and logfile in the order of the plan.  The number of
+/// shards comes from the first line of the cutflow files, which also has
+/// to match this plan (same config and normalized files).  Deletes the
+/// shard files after if cleanup
+void Plotter::mergeShards(const vector<PlotItem>& plan, const string& outname, Logfile& logfile, bool cleanup) {
+  map<int, vector<string>> cutflows;
+  vector<TFile*> shards;
+  int nshards = 1;
+
+  for(int n = 0; n < nshards; n++) {
+    string shardname = getShardName(outname, n);
+    ifstream cutflowfile(shardname + ".cutflow");
+    string line, word;
+    int shard = -1, total = -1, items = -1;
+    if(getline(cutflowfile, line)) {
+      istringstream header(line);
+      header >> word >> shard >> total >> items;
+    }
+    if(n == 0 && total > 0) nshards = total;
+    if(shard != n || total != nshards || items != plan.size()) {
+      cout << shardname << " is missing or doesn't match this config, exiting" << endl;
+      exit(1);
+    }
+    readCutflows(cutflowfile, cutflows);
+
+    TFile* shardfile = TFile::Open(shardname.c_str());
+    if(!shardfile || shardfile->IsZombie()) {
+      cout << "Could not open " << shardname << ", exiting" << endl;
+      exit(1);
+    }
+    shards.push_back(shardfile);
+  }
 
-      /*--------------write out------------*/
+  copyItems(plan, shards, [nshards](int k) {return k % nshards;}, cutflows, logfile);
 
-      datahist->SetMarkerStyle(20);
-      datahist->SetLineColor(1);
+  for(int n = 0; n < nshards; n++) {
+    shards.at(n)->Close();
+    delete shards.at(n);
+    if(!cleanup) continue;
+    unlink(getShardName(outname, n).c_str());
+    unlink((getShardName(outname, n) + ".cutflow").c_str());
+  }
+}
 
-      /// sort based on integral.  Change this function is want other order
-      hs = sortStack(hs);
+//// Writes everything in the plan to the output and logfile in order.
+/// The canvas of item k is read from files.at(fileOf(k))
+void Plotter::copyItems(const vector<PlotItem>& plan, const vector<TFile*>& files, function<int(int)> fileOf, map<int, vector<string>>& cutflows, Logfile& logfile) {
+  for(int k = 0; k < plan.size(); k++) {
+    const PlotItem& item = plan.at(k);
+    if(item.name == "") {
+      logfile.addLine(cutflows[k]);
+      continue;
+    }
+    TKey* key = files.at(fileOf(k))->FindKey(("item" + to_string(k)).c_str());
+    if(!key) continue;   //// nothing to plot (buildPlot gave NULL)
+    TObject* canvas = key->ReadObj();
+    item.target->cd();
+    canvas->Write(canvas->GetName());
+    delete canvas;
+  }
+}
 
-      ///rebin
-      /// default rebinning based on data error.  If no data, bin
-      /// based on background error
-      vector<double> bins;
 
-      TH1D* fullHist = new TH1D("full", readObj->GetTitle(), readObj->GetXaxis()->GetNbins(), readObj->GetXaxis()->GetXmin(), readObj->GetXaxis()->GetXmax());
-      fullHist->Add(error);
-      if(!noData) fullHist->Add(datahist);
-      TH1D* tmpsig = (TH1D*)sigHists->First();
-      while(tmpsig) {
-	fullHist->Add(tmpsig);
-	tmpsig = (TH1D*)sigHists->After(tmpsig);
+//// <spool>/batch<b>, the start of the names of the files of batch b
+string Plotter::getSpoolName(int b) {
+  return spoolDir + "/batch" + to_string(b);
+}
+
+//// host.pid, written in the claims so a stuck batch can be traced back
+string Plotter::getSpoolOwner() {
+  char host[256] = "";
+  gethostname(host, sizeof(host) - 1);
+  return string(host) + "." + to_string(getpid());
+}
+
+//// Makes the spool directory and its plan file if this is the first
+/// process there, then checks that the plan file matches this run (same
+/// items, same batches).  The plan is written to a file of our own and
+/// hard linked to <spool>/plan, only one link can win, so two processes
+/// starting at once can't both write it
+void Plotter::checkSpoolPlan(const vector<PlotItem>& plan) {
+  ostringstream planstream;
+  for(auto& item: plan) planstream << item.path << "/" << item.name << " ";
+  ostringstream header;
+  header << "items " << plan.size() << " batch " << spoolBatch << " plan " << NormCache::hashString(planstream.str());
+
+  if(mkdir(spoolDir.c_str(), 0775) != 0 && errno != EEXIST) {
+    cout << "Could not make spool directory " << spoolDir << ", exiting" << endl;
+    exit(1);
+  }
+  string planname = spoolDir + "/plan";
+  string ownname = planname + "." + getSpoolOwner();
+  ofstream ownfile(ownname);
+  ownfile << header.str() << endl;
+  ownfile.close();
+  link(ownname.c_str(), planname.c_str());
+  unlink(ownname.c_str());
+
+  ifstream planfile(planname);
+  string line;
+  if(!getline(planfile, line) || line != header.str()) {
+    cout << spoolDir << " was made for a different config (or normalized files), ";
+    cout << "clear it out first, exiting" << endl;
+    exit(1);
+  }
+}
+
+//// Spool worker: takes batches of spoolBatch items from the plan until
+/// there are none left.  A batch is claimed by making
+/// <spool>/batch<b>.claim (O_EXCL, only one process gets it), rendered
+/// into files named after this process and then renamed to
+/// batch<b>.root and batch<b>.cutflow.  The .cutflow is renamed last, so
+/// it's there only when the batch is done.  Any number of workers on any
+/// number of hosts can share the spool, big directories are spread over
+/// all of them since the batches go by item, not by directory
+void Plotter::runSpool(const vector<PlotItem>& plan) {
+  checkSpoolPlan(plan);
+  string owner = getSpoolOwner();
+  int nbatches = (plan.size() + spoolBatch - 1) / spoolBatch;
+  int made = 0;
+
+  for(int b = 0; b < nbatches; b++) {
+    string batchname = getSpoolName(b);
+    int claim = open((batchname + ".claim").c_str(), O_CREAT | O_EXCL | O_WRONLY, 0664);
+    if(claim < 0) {
+      if(errno == EEXIST) continue;
+      cout << "Could not claim " << batchname << ", exiting" << endl;
+      exit(1);
+    }
+    string ownerline = owner + "\n";
+    if(write(claim, ownerline.c_str(), ownerline.size()) < 0) cout << "Could not write owner of " << batchname << endl;
+    close(claim);
+
+    string fragment = batchname + "." + owner;
+    TFile* batchfile = new TFile((fragment + ".root").c_str(), "RECREATE");
+    ofstream cutflows(fragment + ".cutflow");
+    renderItems(batchfile, plan, b*spoolBatch, min((int)plan.size(), (b+1)*spoolBatch), 1, cutflows);
+    cutflows.close();
+    batchfile->Close();
+    delete batchfile;
+
+    if(rename((fragment + ".root").c_str(), (batchname + ".root").c_str()) != 0 ||
+       rename((fragment + ".cutflow").c_str(), (batchname + ".cutflow").c_str()) != 0) {
+      cout << "Could not move " << fragment << " into the spool, exiting" << endl;
+      exit(1);
+    }
+    made++;
+  }
+  cout << owner << ": made " << made << " of " << nbatches << " batches" << endl;
+}
+
+//// Puts a finished spool together into the output and logfile, in the
+/// order of the plan.  Stops if any batch isn't done yet.  The spool is
+/// left as it is
+void Plotter::mergeSpool(const vector<PlotItem>& plan, Logfile& logfile) {
+  checkSpoolPlan(plan);
+  int nbatches = (plan.size() + spoolBatch - 1) / spoolBatch;
+  map<int, vector<string>> cutflows;
+  vector<TFile*> batches;
+  vector<int> missing;
+
+  for(int b = 0; b < nbatches; b++) {
+    string batchname = getSpoolName(b);
+    ifstream cutflowfile(batchname + ".cutflow");
+    if(!cutflowfile) {
+      missing.push_back(b);
+      continue;
+    }
+    readCutflows(cutflowfile, cutflows);
+
+    TFile* batchfile = TFile::Open((batchname + ".root").c_str());
+    if(!batchfile || batchfile->IsZombie()) {
+      cout << "Could not open " << batchname << ".root, exiting" << endl;
+      exit(1);
+    }
+    batches.push_back(batchfile);
+  }
+
+  if(missing.size() > 0) {
+    cout << missing.size() << " of " << nbatches << " batches aren't done:";
+    for(auto b: missing) cout << " " << b;
+    cout << endl << "If no worker is still running, delete their .claim files in ";
+    cout << spoolDir << " and start a worker again, exiting" << endl;
+    exit(1);
+  }
+
+  copyItems(plan, batches, [](int k) {return k / spoolBatch;}, cutflows, logfile);
+
+  for(auto batchfile: batches) {
+    batchfile->Close();
+    delete batchfile;
+  }
+}
+
+
+//// Goes through the directory tree of the reference file (depth first,
+/// same order as the keys) and lists everything that gets written: the
+/// cutflow line of each directory that has Events and every plot.  Makes
+/// the output directories as it goes.  With a filter (-only/-exclude),
+/// only the plots it keeps are planned, and only directories with some of
+/// them (under them) are made and get a cutflow line
+void Plotter::planStack(TDirectory* target, const string& dirpath, vector<PlotItem>& plan) {
+  if(histIndex->getReference(dirpath, "Events") && hasPlots(dirpath)) plan.push_back(PlotItem{target, dirpath, ""});
+
+  for(auto& name: histIndex->getNames(dirpath)) {
+    if(dirpath == "" && name == Normer::pyramidDir) continue;   //// levels, read by buildPlot
+    TKey* key = histIndex->getReference(dirpath, name);
+    TClass* cl = TClass::GetClass(key->GetClassName());
+    if ( cl == TH1D::Class() || cl == TH1F::Class() ) {
+      if(!filter || filter->keep(dirpath, name)) plan.push_back(PlotItem{target, dirpath, name});
+    } else if ( histIndex->isDirectory(dirpath, name) ) {
+      string subpath = (dirpath == "") ? name : dirpath + "/" + name;
+      if(!hasPlots(subpath)) continue;
+      target->cd();
+      TDirectory *newdir = target->mkdir( name.c_str(), key->GetTitle() );
+      planStack(newdir, subpath, plan);
+    } else if ( cl && cl->InheritsFrom( TH1::Class() ) ) {
+      continue;
+    } else {
+      cout << "Unknown object type, name: "
+	   << name << " title: " << key->GetTitle() << endl;
+    }
+  }
+}
+
+//// True if the filter keeps any plot in this directory or under it.
+/// Always true without a filter
+bool Plotter::hasPlots(const string& dirpath) {
+  if(!filter) return true;
+  for(auto& name: histIndex->getNames(dirpath)) {
+    if(dirpath == "" && name == Normer::pyramidDir) continue;
+    TKey* key = histIndex->getReference(dirpath, name);
+    TClass* cl = TClass::GetClass(key->GetClassName());
+    if ( cl == TH1D::Class() || cl == TH1F::Class() ) {
+      if(filter->keep(dirpath, name)) return true;
+    } else if ( histIndex->isDirectory(dirpath, name) ) {
+      if(hasPlots((dirpath == "") ? name : dirpath + "/" + name)) return true;
+    }
+  }
+  return false;
+}
+
+//// Cutflow line (pass bin of Events of every file) of the directory for
+/// the logfile
+vector<string> Plotter::getCutflow(TDirectory* target, const string& dirpath) {
+  vector<string> logEff;
+  string totalval = "";
+  logEff.push_back((dirpath == "") ? FileList[1]->First()->GetName() : target->GetName());
+
+  for(int i=0; i < 3; i++) {
+    const vector<TKey*>& eventkeys = histIndex->find(i, dirpath, "Events");
+    for(int j = 0; j < eventkeys.size(); j++) {
+      if(!eventkeys.at(j)) {
+	logEff.push_back("-");
+	continue;
+      }
+      double pass, passErr;
+      if(stores[i].at(j)) {
+	pass = stores[i].at(j)->getContent(dirpath, "Events", 2);
+	passErr = stores[i].at(j)->getError(dirpath, "Events", 2);
+      } else {
+	TH1* events = readHist(i, j, dirpath, "Events", eventkeys.at(j));
+	pass = events->GetBinContent(2);
+	passErr = events->GetBinError(2);
+	delete events;
       }
+      totalval = to_string_with_precision(pass, 1);
+      if(i != 0) totalval += " $\\pm$ " + to_string_with_precision(passErr, 1);
+      logEff.push_back(totalval);
+    }
+  }
+  return logEff;
+}
+
 
-      // if(noData ) bins = rebinner(error, styler.getRebinLimit());
-      // else bins = rebinner(datahist, styler.getRebinLimit());
-      if(explicitBins.find(readObj->GetTitle()) == explicitBins.end()) bins = rebinner(fullHist, styler.getRebinLimit());
-      else {
-	bins.push_back(readObj->GetXaxis()->GetXmin());
-	double lastbin = readObj->GetXaxis()->GetXmax();
-	double currentVal = bins.at(0);
-
-	for(auto it: explicitBins[readObj->GetTitle()]) {
-	  int numLeft = it.first;
-	  double binWidth = it.second;
-	  if(binWidth <= 0) {
-	    if(numLeft <= 0) {
-	      numLeft = 1;
-	    }
-	    binWidth = lastbin - currentVal/numLeft;
-	  } else if(numLeft <= 0) {
-	    numLeft = (int)((lastbin - currentVal)/binWidth);
+//// Gathers histogram name in dirpath from all of the files and makes
+/// everything that goes on its canvas: sorted and rebinned stack, data,
+/// signal, error bands and the bottom plot.  Doesn't draw anything or
+/// touch gDirectory, so it can run in a worker.  NULL if there is
+/// nothing to plot
+Plotter::PlotPieces* Plotter::buildPlot(const string& dirpath, const string& name, TKey* key) {
+  /// h1 is the reference histogram to grab the other histos.
+  /// here we also make the containers for the graphs
+  ///// RebinFactor in the style file: plots get fixed bins, factor times
+  /// wider.  Read straight from that level of the pyramid if the
+  /// normalized files have one (-pyramid), if not rebin here
+  int factor;
+  string readpath = getReadPath(dirpath, name, factor);
+  if(readpath != dirpath) key = histIndex->getReference(readpath, name);
+
+  //// nothing to plot, known from the summaries without reading anything
+  if(factor == 1 && isEmptyPlot(readpath, name)) {
+    skippedEmpty++;
+    return NULL;
+  }
+
+  //// everything made for this plot belongs to the arena
+  PlotArena* arena = new PlotArena();
+  TH1* readObj = arena->own(readHist(1, 0, readpath, name, key));
+  if(factor > 1) readObj->Rebin(factor);
+  TH1D* error = arena->own(new TH1D("error", readObj->GetTitle(), readObj->GetXaxis()->GetNbins(), readObj->GetXaxis()->GetXmin(), readObj->GetXaxis()->GetXmax()));
+  TH1D* datahist = arena->own(new TH1D("data", readObj->GetTitle(), readObj->GetXaxis()->GetNbins(), readObj->GetXaxis()->GetXmin(), readObj->GetXaxis()->GetXmax()));
+  TList* sigHists = arena->own(new TList());
+  THStack *hs = arena->own(new THStack(readObj->GetName(),readObj->GetName()));
+
+  /*------------data--------------*/
+
+  //////  This iterates over all the different files in the
+  //// FileList array.  Looks a little dirty, but makes the code compact and
+  //// not messy.  If statements based on array position (ie which type of file)
+  //// tell were to put the histograms.  If adding things, go to respective
+  //// if statement.  Want to make styling more robust here, but will take some
+  //// annoying configuration stuff.  Maybe later
+
+  int nfile = 0;
+  bool noData = FileList[0]->GetSize() == 0;
+  vector<double> stackIntegrals;
+
+  //// data, the background sum and everything put together for the
+  /// rebinning are added up on the arrays as the groups come in.  Groups
+  /// in the store are added straight from its buffers, so only what is
+  /// drawn on its own (stack and signal) is made into a histogram
+  int nbins = readObj->GetXaxis()->GetNbins();
+  TH1D* fullHist = PlotArena::scratchHist(readObj->GetTitle(), nbins, readObj->GetXaxis()->GetXmin(), readObj->GetXaxis()->GetXmax());
+  double *fullw, *fullw2, *dataw, *dataw2, *errorw, *errorw2;
+  getArrays(fullHist, fullw, fullw2);
+  getArrays(datahist, dataw, dataw2);
+  getArrays(error, errorw, errorw2);
+  double dataEntries = 0, errorEntries = 0, sigEntries = 0;
+
+  for(int i = 0; i < 3; i++) {
+    const vector<TKey*>& keys = histIndex->find(i, readpath, name);
+    TFile* nextfile = (TFile*)FileList[i]->First();
+    for(int j = 0; j < keys.size(); j++) {
+      if(keys.at(j)) {
+	HistStore* store = stores[i].at(j);
+	if(factor > 1 || (store && store->getNbins(readpath, name) != nbins)) store = NULL;
+	TH1* h2 = NULL;
+	double entries = (store) ? store->getEntries(readpath, name) : 0;
+	if(!store || i != 0) {
+	  h2 = arena->own(readHist(i, j, readpath, name, keys.at(j)));
+	  if(factor > 1) h2->Rebin(factor);
+	  entries = h2->GetEntries();
+	}
+ /*------------Data--------------*/
+	if(i == 0) {
+	  if(store) store->addTo(readpath, name, dataw, dataw2);
+	  else addHist(datahist, h2);
+	  dataEntries += entries;
+	}
+	else if(i == 1) {
+ /*------------background--------------*/
+	  if(store) store->addTo(readpath, name, errorw, errorw2);
+	  else addHist(error, h2);
+	  errorEntries += entries;
+	  for(int j = 1; j < h2->GetXaxis()->GetNbins()+1; j++) {
+	    h2->SetBinError(j, 0);
 	  }
-	  while(numLeft > 0 && lastbin - currentVal > EPSILON_VALUE) {
-	    currentVal += binWidth;
-	    bins.push_back(currentVal);
-	    numLeft--;
+	  //////style
+	  string title = nextfile->GetTitle();
+	  title = title.substr(0, title.size()-5);
+	  h2->SetTitle(title.c_str());
+	  h2->SetLineColor(color[nfile]);
+	  h2->SetFillStyle(1001);
+	  h2->SetFillColor(color[nfile]);
+
+	  const HistSummary* found = (factor == 1 && summaries[i].at(j)) ? summaries[i].at(j)->find(readpath, name) : NULL;
+	  stackIntegrals.push_back((found) ? found->integral : h2->Integral());
+	  hs->Add(h2);
+	  nfile++;
+	} else if(i == 2) {
+ /*------------Signal--------------*/
+	  for(int j = 1; j < h2->GetXaxis()->GetNbins()+1; j++) {
+	    h2->SetBinError(j, 0);
 	  }
+	  //// without its errors, same as the histogram
+	  if(store) store->addTo(readpath, name, fullw, NULL);
+	  else addHist(fullHist, h2);
+	  sigEntries += entries;
+
+	  //////style
+	  string title = nextfile->GetTitle();
+	  title = title.substr(0, title.size()-5);
+	  h2->SetTitle(title.c_str());
+	  h2->SetLineColor(color[nfile]);
+	  h2->SetLineWidth(3);
+	  h2->SetLineStyle(2);
+
+	  sigHists->Add(h2);
+	  nfile++;
 	}
-	if(abs(currentVal-lastbin) > EPSILON_VALUE) bins.push_back(lastbin);
-
-	reverse(bins.begin(), bins.end());
 
       }
+      nextfile = (TFile*)FileList[i]->After(nextfile);
+    }
+  }
+  datahist->ResetStats();
+  datahist->SetEntries(dataEntries);
+  error->ResetStats();
+  error->SetEntries(errorEntries);
 
-      //// need to get rid of continue if possible because dirty deleting
-      /// happening here.  Maybe put CreateStack in main and make the class
-      /// the stuff that happens in the loop?  Then just make a destructor.
-      /// that would be pretty.  huh
-      if(bins.size() == 0) {
-	hs->Delete();
-	delete datahist;
-	delete error;
-	delete sigHists;
-	continue;
-      }
+  /*--------------write out------------*/
 
-      /// Check if rebin vector is in decending order (sometimes didn't happen??)
-      /// then puts into a double array in increasing order for Rebin function
-      double* binner = new double[bins.size()+1];
-      bool passed = true;
-
-      binner[0] = bins.back();
-      for(int i = 1; i < bins.size(); i++) {
-      	if(bins.at(bins.size() - i) >= bins.at(bins.size() - i - 1))  {
-      	  passed = false;
-      	  break;
-      	}
-      	binner[i] = bins.at(bins.size() - i - 1);
-      }
+  datahist->SetMarkerStyle(20);
+  datahist->SetLineColor(1);
 
+  /// sort based on integral.  Change this function is want other order
+  hs = sortStack(hs, stackIntegrals, *arena);
 
-      ////rebin histograms
-      /// make new stack because hs gets deleted in teh rebinstack function.  Maybe
-      /// this isn't necessary.  A little jaring to make the change.  Also, I've put
-      /// hs instead of hsdraw so many times...
-      THStack* hsdraw = hs;
-      if(styler.getDivideBins() && passed && bins.size() > styler.getBinLimit()) {
-	      datahist = (TH1D*)datahist->Rebin(bins.size()-1, "data_rebin", binner);
-      	error = (TH1D*)error->Rebin(bins.size()-1, "error_rebin", binner);
-      	hsdraw = rebinStack(hs, binner, bins.size()-1);
-      	TList* tmplist = new TList();
-      	TH1D* onesig = (TH1D*)sigHists->First();
-      	while(onesig) {
-      	  tmplist->Add(onesig->Rebin(bins.size()-1, onesig->GetName(), binner));
-      	  onesig = (TH1D*)sigHists->After(onesig);
-      	}
-	//if(do_overflow){
-	  //int last_bin=datahist->GetNbinsX();
-	  //datahist->SetBinContent(last_bin,datahist->GetBinContent(last_bin+1));
-	  //datahist->SetBinError(last_bin,datahist->GetBinError(last_bin+1));
-
-	  //error->SetBinContent(last_bin,datahist->GetBinError(last_bin+1));
-	  //error->SetBinError(last_bin,lastbin_error_error);
-
-	  //TList* list = (TList*)hsdraw->GetHists();
-	  //TH1D* tmp = (TH1D*)list->First();
-	  //int i=0;
-	  //while ( tmp ) {
-	    //tmp->SetBinContent(last_bin,lastbin_bg.at(i));
-	    //tmp->SetBinError(last_bin,lastbin_bg_error.at(i));
-	    //tmp = (TH1D*)list->After(tmp);
-	    //i++;
-	  //}
-
-	  //tmp = (TH1D*)sigHists->First();
-	  //while ( tmp ) {
-	    //tmp->SetBinContent(last_bin,lastbin_sg.at(i));
-	    //tmp->SetBinError(last_bin,lastbin_sg_error.at(i));
-	    //tmp = (TH1D*)sigHists->After(tmp);
-	  //}
-
-	//}
-      	delete sigHists;
-      	sigHists = tmplist;
-        divideBin(datahist, error, hsdraw, sigHists);
-      }
+  ///rebin
+  /// default rebinning based on the errors of everything put together,
+  /// unless there is an explicit binning for it (see Rebinner).  Edges
+  /// always come back going up, empty means nothing to plot
+  addBins(fullw, fullw2, errorw, errorw2, nbins);
+  if(!noData) addBins(fullw, fullw2, dataw, dataw2, nbins);
+  fullHist->SetEntries(errorEntries + ((noData) ? 0 : dataEntries) + sigEntries);
 
-      ///legend stuff
-      TLegend* legend = createLeg(datahist, hsdraw->GetHists(), sigHists);
+  vector<double> bins = (styler.getRebinFactor() > 1) ? Rebinner::fromAxis(fullHist) :
+    rebinner.getEdges(fullHist, styler.getRebinLimit());
 
-      ////divide by binwidth is option is given
-      //if(styler.getDivideBins()) divideBin(datahist, error, hsdraw, sigHists);
+  if(bins.size() == 0) {
+    delete arena;
+    return NULL;
+  }
+  const double* binner = bins.data();
+
+
+  ////rebin histograms
+  /// make new stack because hs gets deleted in teh rebinstack function.  Maybe
+  /// this isn't necessary.  A little jaring to make the change.  Also, I've put
+  /// hs instead of hsdraw so many times...
+  THStack* hsdraw = hs;
+  if(styler.getRebinFactor() <= 1 && styler.getDivideBins() && bins.size() > styler.getBinLimit()) {
+    datahist = arena->own((TH1D*)datahist->Rebin(bins.size()-1, "data_rebin", binner));
+    error = arena->own((TH1D*)error->Rebin(bins.size()-1, "error_rebin", binner));
+    hsdraw = rebinStack(hs, binner, bins.size()-1, *arena);
+    TList* tmplist = arena->own(new TList());
+    TH1D* onesig = (TH1D*)sigHists->First();
+    while(onesig) {
+      tmplist->Add(arena->own(onesig->Rebin(bins.size()-1, onesig->GetName(), binner)));
+      onesig = (TH1D*)sigHists->After(onesig);
+    }
+    //if(do_overflow){
+      //int last_bin=datahist->GetNbinsX();
+      //datahist->SetBinContent(last_bin,datahist->GetBinContent(last_bin+1));
+      //datahist->SetBinError(last_bin,datahist->GetBinError(last_bin+1));
+
+      //error->SetBinContent(last_bin,datahist->GetBinError(last_bin+1));
+      //error->SetBinError(last_bin,lastbin_error_error);
+
+      //TList* list = (TList*)hsdraw->GetHists();
+      //TH1D* tmp = (TH1D*)list->First();
+      //int i=0;
+      //while ( tmp ) {
+	//tmp->SetBinContent(last_bin,lastbin_bg.at(i));
+	//tmp->SetBinError(last_bin,lastbin_bg_error.at(i));
+	//tmp = (TH1D*)list->After(tmp);
+	//i++;
+      //}
+
+      //tmp = (TH1D*)sigHists->First();
+      //while ( tmp ) {
+	//tmp->SetBinContent(last_bin,lastbin_sg.at(i));
+	//tmp->SetBinError(last_bin,lastbin_sg_error.at(i));
+	//tmp = (TH1D*)sigHists->After(tmp);
+      //}
+
+    //}
+    sigHists = tmplist;
+    divideBin(datahist, error, hsdraw, sigHists);
+  }
 
-      //error for top
-      TGraphErrors* errorstack = createError(error, false);
+  //error for top
+  TGraphErrors* errorstack = createError(error, false, *arena);
 
-      ////draw graph
-      target->cd();
+  //// bottom plot.  Drawn in drawPlot
+  TGraphErrors* errorratio = NULL;
+  TList* signalBot = NULL;
+  if( !onlyTop ) {
+    signalBot = (bottomType != Ratio) ? signalBottom(sigHists, error, *arena) : signalBottom(sigHists, datahist, error, *arena);
+    errorratio = createError(error, true, *arena);
+  }
 
-      TCanvas *c = new TCanvas(readObj->GetName(), readObj->GetName());//403,50,600,600);
-      //// need to work on top text
-      // TPaveText* text = new TPaveText(0.05, 0.7, 0.5, 1.);
-      // text->AddText("CMS Preliminary");
-      // text->Draw();
+  PlotPieces* pieces = new PlotPieces;
+  pieces->readObj = readObj;
+  pieces->datahist = datahist;
+  pieces->error = error;
+  pieces->sigHists = sigHists;
+  pieces->signalBot = signalBot;
+  pieces->hsdraw = hsdraw;
+  pieces->errorstack = errorstack;
+  pieces->errorratio = errorratio;
+  pieces->arena = arena;
+  return pieces;
+}
 
-      if(!(onlyTop)) {
-	c->Divide(1,2);
-	c->cd(1);
-	sizePad(styler.getPadRatio(), gPad, true);
-      }
 
-      hsdraw->Draw();
-      datahist->Draw("e1same");
+//// Draws the pieces made by buildPlot on a canvas and writes it to
+/// target (under keyname if given, else the canvas name).  ROOT graphics
+/// aren't thread safe, so only the main thread calls this.  Deletes the
+/// pieces when done
+void Plotter::drawPlot(TDirectory* target, PlotPieces* pieces, string keyname) {
+  TH1* readObj = pieces->readObj;
+  TH1D* datahist = pieces->datahist;
+  TH1D* error = pieces->error;
+  TList* sigHists = pieces->sigHists;
+  TList* signalBot = pieces->signalBot;
+  THStack* hsdraw = pieces->hsdraw;
+  TGraphErrors* errorstack = pieces->errorstack;
+  TGraphErrors* errorratio = pieces->errorratio;
+  bool noData = FileList[0]->GetSize() == 0;
+  bool do_overflow = styler.getDoOverflow();
 
-    TPaveText *pt = new TPaveText(0.80,0.941,0.95,1.0,"NBNDC");
-    pt->AddText("35.9 fb^{-1} (13 TeV)");
-    pt->SetTextFont(42);
-    pt->SetTextAlign(32);
-    pt->SetFillStyle(0);
-    pt->SetBorderSize(0);
-    pt->Draw();
+  ///legend stuff
+  PlotArena* arena = pieces->arena;
+  TLegend* legend = createLeg(datahist, hsdraw->GetHists(), sigHists, *arena);
+  TH1D* tmpsig = NULL;
 
-    TPaveText *pt2 = new TPaveText(0.09,0.88,0.21,0.95,"NBNDC");
-    pt2->AddText("CMS ");
-    pt2->SetTextAlign(12);
-    pt2->SetFillStyle(0);
-    pt2->SetBorderSize(0);
-    pt2->Draw();
+  ////draw graph
+  target->cd();
 
-    TPaveText *pt3 = new TPaveText(0.09,0.82,0.21,0.88,"NBNDC");
-    pt3->AddText("Work in Progress");
-    pt3->SetTextAlign(12);
-    pt3->SetTextFont(52);
-    pt3->SetFillStyle(0);
-    pt3->SetBorderSize(0);
-    pt3->Draw();
+  TCanvas *c = arena->own(new TCanvas(readObj->GetName(), readObj->GetName()));//403,50,600,600);
+  //// need to work on top text
+  // TPaveText* text = new TPaveText(0.05, 0.7, 0.5, 1.);
+  // text->AddText("CMS Preliminary");
+  // text->Draw();
 
+  if(!(onlyTop)) {
+    c->Divide(1,2);
+    c->cd(1);
+    sizePad(styler.getPadRatio(), gPad, true);
+  }
 
+  hsdraw->Draw();
+  datahist->Draw("e1same");
+
+  TPaveText *pt = arena->own(new TPaveText(0.80,0.941,0.95,1.0,"NBNDC"));
+  pt->AddText("35.9 fb^{-1} (13 TeV)");
+  pt->SetTextFont(42);
+  pt->SetTextAlign(32);
+  pt->SetFillStyle(0);
+  pt->SetBorderSize(0);
+  pt->Draw();
+
+  TPaveText *pt2 = arena->own(new TPaveText(0.09,0.88,0.21,0.95,"NBNDC"));
+  pt2->AddText("CMS ");
+  pt2->SetTextAlign(12);
+  pt2->SetFillStyle(0);
+  pt2->SetBorderSize(0);
+  pt2->Draw();
+
+  TPaveText *pt3 = arena->own(new TPaveText(0.09,0.82,0.21,0.88,"NBNDC"));
+  pt3->AddText("Work in Progress");
+  pt3->SetTextAlign(12);
+  pt3->SetTextFont(52);
+  pt3->SetFillStyle(0);
+  pt3->SetBorderSize(0);
+  pt3->Draw();
 
 
-      tmpsig = (TH1D*)sigHists->First();
-      while(tmpsig) {
-	tmpsig->Draw("same");
-	tmpsig = (TH1D*)sigHists->After(tmpsig);
-      }
-      errorstack->Draw("2");
-      legend->Draw();
-      setYAxisTop(datahist, error, styler.getHeightRatio(), hsdraw);
-      if(noData) {
-	hsdraw->GetXaxis()->SetTitle(newLabel(hsdraw->GetTitle()).c_str());
-	hsdraw->GetXaxis()->SetTitleSize(hsdraw->GetYaxis()->GetLabelSize());
-      }
-      if(do_overflow){
-        //latex.SetNDC();
-        //latex.SetTextAngle(90);
-        //latex.SetTextColor(kBlack);
-        //latex.SetTextFont(43);
-        //latex.SetTextAlign(31);
-        //latex.SetTextSize(16);
-        //latex.DrawLatex(0.97,0.3,"Overflow");
-      }
 
-      // ///second pad
-      TF1* PrevFitTMP = NULL;
-      TGraphErrors* errorratio = NULL;
-      TList* signalBot = NULL;
 
-      if( !onlyTop ) {
-	c->cd(2);
-	sizePad(styler.getPadRatio(), gPad, false);
+  tmpsig = (TH1D*)sigHists->First();
+  while(tmpsig) {
+    tmpsig->Draw("same");
+    tmpsig = (TH1D*)sigHists->After(tmpsig);
+  }
+  errorstack->Draw("2");
+  legend->Draw();
+  setYAxisTop(datahist, error, styler.getHeightRatio(), hsdraw);
+  if(noData) {
+    hsdraw->GetXaxis()->SetTitle(newLabel(hsdraw->GetTitle()).c_str());
+    hsdraw->GetXaxis()->SetTitleSize(hsdraw->GetYaxis()->GetLabelSize());
+  }
+  if(do_overflow){
+    //latex.SetNDC();
+    //latex.SetTextAngle(90);
+    //latex.SetTextColor(kBlack);
+    //latex.SetTextFont(43);
+    //latex.SetTextAlign(31);
+    //latex.SetTextSize(16);
+    //latex.DrawLatex(0.97,0.3,"Overflow");
+  }
 
-	TH1* botaxis = error;
-	botaxis->Draw("AXIS");
-	setXAxisBot(botaxis, styler.getPadRatio());
 
-	signalBot = (bottomType != Ratio) ? signalBottom(sigHists, error) : signalBottom(sigHists, datahist, error);
 
-	errorratio = createError(error, true);
-	if(bottomType == Ratio) {
-	  tmpsig = (TH1D*)signalBot->Last();
-	  PrevFitTMP = createLine(tmpsig);
-	  setYAxisBot(error->GetYaxis(), tmpsig, styler.getPadRatio());
-	} else setYAxisBot(botaxis->GetYaxis(), signalBot, styler.getPadRatio());
+  // ///second pad
+  TF1* PrevFitTMP = NULL;
 
-	tmpsig = (TH1D*)signalBot->First();
-	while(tmpsig) {
-	  tmpsig->Draw("same");
-	  tmpsig = (TH1D*)signalBot->After(tmpsig);
-	}
-	if(bottomType == Ratio) errorratio->Draw("2");
-      }
+  if( !onlyTop ) {
+    c->cd(2);
+    sizePad(styler.getPadRatio(), gPad, false);
 
-      c->cd();
-      c->Write(c->GetName());
-      c->Close();
-
-      /// so many delete.  Probably not doing this right, but this program is so small
-      /// memory leaks basically don't matter.
-      /// delete vs Delete() still up in the air.  delete doesn't delete objects in container
-      /// while Delete() does, but this only is true sometimes.  idk
-      hsdraw->Delete();
-      delete datahist;
-      delete error;
-      delete sigHists;
-      delete legend;
-      delete errorstack;
-
-      delete[] binner;
-      if( !onlyTop ) {
-        // delete errorratio;
-        // delete PrevFitTMP;
-        signalBot->Delete();
-      }
+    TH1* botaxis = error;
+    botaxis->Draw("AXIS");
+    setXAxisBot(botaxis, styler.getPadRatio());
 
-    } else if ( obj->IsA()->InheritsFrom( TDirectory::Class() ) ) {
+    if(bottomType == Ratio) {
+      tmpsig = (TH1D*)signalBot->Last();
+      //// belongs to tmpsig (its list of functions), not the arena
+      PrevFitTMP = createLine(tmpsig);
+      setYAxisBot(error->GetYaxis(), tmpsig, styler.getPadRatio());
+    } else setYAxisBot(botaxis->GetYaxis(), signalBot, styler.getPadRatio());
 
-      target->cd();
-      TDirectory *newdir = target->mkdir( obj->GetName(), obj->GetTitle() );
+    tmpsig = (TH1D*)signalBot->First();
+    while(tmpsig) {
+      tmpsig->Draw("same");
+      tmpsig = (TH1D*)signalBot->After(tmpsig);
+    }
+    if(bottomType == Ratio) errorratio->Draw("2");
+  }
 
-      CreateStack( newdir, logfile );
+  c->cd();
+  c->Write((keyname == "") ? c->GetName() : keyname.c_str());
+  c->Close();
 
-    } else if ( obj->IsA()->InheritsFrom( TH1::Class() ) ) {
+  //// the arena has everything (histograms, stacks, lists, canvas, text)
+  delete arena;
+  delete pieces;
+}
 
-      continue;
 
-    } else {
-         cout << "Unknown object type, name: "
-	   << obj->GetName() << " title: " << obj->GetTitle() << endl;
+
+//// Gets histogram name in path from file j of type i.  Comes from the
+/// in memory store if there is one, else it is read from the key.  Keys
+/// the plan will read (planReads) are read with the planned ones after
+/// them in the directory from the same file, in offset order
+/// (ReadPlanner), and the rest are kept until they are asked for.  Safe
+/// to call from the plot workers
+TH1* Plotter::readHist(int i, int j, const string& path, const string& name, TKey* key) {
+  if(stores[i].at(j)) return stores[i].at(j)->makeHist(path, name);
+
+  //// a TFile can only be read by one thread at a time
+  lock_guard<mutex> lock(readLock);
+  auto uses = plannedUses.find(key);
+  if(uses == plannedUses.end() || uses->second <= 0) return (TH1*)key->ReadObj();
+
+  if(readAhead.find(key) == readAhead.end()) {
+    const vector<string>& names = plannedNames[path];
+    vector<TKey*> keys(1, key);
+    Long64_t bytes = key->GetObjlen();
+    for(int n = plannedPlace[path + "\t" + name] + 1; n < names.size() && bytes < readAheadBytes; n++) {
+      TKey* next = histIndex->find(i, path, names.at(n)).at(j);
+      auto nextUses = plannedUses.find(next);
+      if(!next || nextUses == plannedUses.end() || nextUses->second <= 0 || readAhead.count(next)) continue;
+      keys.push_back(next);
+      bytes += next->GetObjlen();
     }
+    ReadPlanner::read(keys, [&](int k, TObject* object) {readAhead[keys.at(k)] = (TH1*)object;});
   }
 
-  TH1::AddDirectory(status);
+  //// the reference file is read twice for a plot (readObj and in the
+  /// stack), all but the last use get a copy
+  auto found = readAhead.find(key);
+  TH1* hist = found->second;
+  if(--uses->second > 0) return (TH1*)hist->Clone();
+  readAhead.erase(found);
+  return hist;
 }
 
+//// Where the plot of name in dirpath is read from: the level of the
+/// pyramid for RebinFactor if the normalized files have one (factor is
+/// then 1), dirpath if not (factor is what it still has to be rebinned by)
+string Plotter::getReadPath(const string& dirpath, const string& name, int& factor) {
+  factor = styler.getRebinFactor();
+  string pyramidpath = Normer::getPyramidPath(dirpath, factor);
+  if(factor > 1 && histIndex->getReference(pyramidpath, name)) {
+    factor = 1;
+    return pyramidpath;
+  }
+  return dirpath;
+}
+
+//// What items first, first+step, ... up to last of the plan will read
+/// (readHist): every key of each plot that isn't skipped as empty, the
+/// reference key once more, and the Events keys of the cutflow lines
+void Plotter::planReads(const vector<PlotItem>& plan, int first, int last, int step) {
+  clearReads();
+  for(int k = first; k < last; k += step) {
+    const PlotItem& item = plan.at(k);
+    string path = item.path, name = "Events";
+    if(item.name != "") {
+      int factor;
+      name = item.name;
+      path = getReadPath(item.path, name, factor);
+      if(factor == 1 && isEmptyPlot(path, name)) continue;
+      TKey* reference = histIndex->getReference(path, name);
+      if(reference) plannedUses[reference]++;
+    }
+
+    if(plannedPlace.find(path + "\t" + name) == plannedPlace.end()) {
+      plannedPlace[path + "\t" + name] = plannedNames[path].size();
+      plannedNames[path].push_back(name);
+    }
+    for(int i = 0; i < 3; i++) {
+      for(auto key: histIndex->find(i, path, name)) {
+	if(key) plannedUses[key]++;
+      }
+    }
+  }
+}
+
+//// Anything read ahead and never used (a plot that stopped early) is
+/// deleted
+void Plotter::clearReads() {
+  for(auto& ahead: readAhead) delete ahead.second;
+  readAhead.clear();
+  plannedNames.clear();
+  plannedPlace.clear();
+  plannedUses.clear();
+}
 
 
 template <typename T>
@@ -457,43 +923,59 @@ string to_string_with_precision(const T a_value, const int n)
 
 
 ///// Function takes an old THStack and sorts the stack based on
-//// integral of the graph, smallest to largest.
-/// deletes old stack so pointer nonsense doesn't happen
-THStack* Plotter::sortStack(THStack* old) {
+//// integral of the graph, smallest to largest (integrals are in the
+/// order the histograms were added, equal ones keep that order).  The old
+/// stack (and the histograms) still belong to the plot arena
+THStack* Plotter::sortStack(THStack* old, const vector<double>& integrals, PlotArena& arena) {
   if(old == NULL || old->GetNhists() == 0) return old;
   string name = old->GetName();
-  THStack* newstack = new THStack(name.c_str(),name.c_str());
+  THStack* newstack = arena.own(new THStack(name.c_str(),name.c_str()));
 
-  TList* list = (TList*)old->GetHists();
+  vector<TH1*> hists;
+  TIter next(old->GetHists());
+  TH1* tmp = NULL;
+  while( (tmp = (TH1*)next()) ) hists.push_back(tmp);
+
+  vector<int> order;
+  for(int k = 0; k < hists.size(); k++) order.push_back(k);
+  stable_sort(order.begin(), order.end(), [&](int a, int b) {return integrals.at(a) < integrals.at(b);});
+  for(auto k: order) newstack->Add(hists.at(k));
 
-  while(list->GetSize() > 1) {
+  return newstack;
+}
 
-    TH1* smallest = (TH1*)list->First();;
-    TH1* tmp = (TH1*)list->After(smallest);
-    while ( tmp ) {
-      if(smallest->Integral() > tmp->Integral()) smallest = tmp;
-      tmp = (TH1*)list->After(tmp);
+//// True if the summaries of the normalized files say this plot has
+/// nothing in it (what the Rebinner would find from the summed
+/// histogram), so nothing has to be read.  False if any file with the
+/// histogram has no summary for it, or it has an explicit binning
+bool Plotter::isEmptyPlot(const string& dirpath, const string& name) {
+  double entries = 0, integral = 0;
+  string title;
+  for(int i = 0; i < 3; i++) {
+    const vector<TKey*>& keys = histIndex->find(i, dirpath, name);
+    for(int j = 0; j < keys.size(); j++) {
+      if(!keys.at(j)) continue;
+      const HistSummary* found = (summaries[i].at(j)) ? summaries[i].at(j)->find(dirpath, name) : NULL;
+      if(!found) return false;
+      entries += found->entries;
+      integral += found->integral;
+      title = found->title;
     }
-    newstack->Add(smallest);
-    list->Remove(smallest);
   }
-  TH1* last = (TH1*)list->First();
-  if(last) newstack->Add(last);
-
-  delete old;
-  return newstack;
+  if(rebinner.hasSpec(title)) return false;
+  return entries == 0 || integral <= 0;
 }
 
 
 ////make legend position adjustable
 //// Puts all of the histograms in the legend.  Set so backgrounds show up
 /// as colored blocks, but signal and data as T's in the format they are on the graph
-TLegend* Plotter::createLeg(const TH1* data, const TList* bgl, const TList* sigl) {
+TLegend* Plotter::createLeg(const TH1* data, const TList* bgl, const TList* sigl, PlotArena& arena) {
   double width = 0.05;
   int items = bgl->GetSize() + sigl->GetSize();
   items += (data->GetEntries() != 0) ? 1 : 0;
 //TLegend* leg = new TLegend(0.73, 0.9-items*width ,0.93,0.90);
-  TLegend* leg = new TLegend(0.79, 0.92-(items+1)*width ,0.94,0.92);
+  TLegend* leg = arena.own(new TLegend(0.79, 0.92-(items+1)*width ,0.94,0.92));
 
   if(data->GetEntries() != 0) leg->AddEntry(data, "Data", "lep");
   TH1* tmp = (TH1*)bgl->First();
@@ -508,7 +990,7 @@ TLegend* Plotter::createLeg(const TH1* data, const TList* bgl, const TList* sigl
   }
 
 
-   TH1* mcErrorleg = new TH1I("mcErrorleg", "BG stat. uncer.", 100, 0.0, 4.0);
+   TH1* mcErrorleg = arena.own(new TH1I("mcErrorleg", "BG stat. uncer.", 100, 0.0, 4.0));
     mcErrorleg->SetLineWidth(1);
     mcErrorleg->SetFillColor(kMagenta+1);
     mcErrorleg->SetFillStyle(3004);
@@ -524,29 +1006,29 @@ TLegend* Plotter::createLeg(const TH1* data, const TList* bgl, const TList* sigl
 /// tricky function because it takes a bool to ask if you want the ratio
 /// plots error or the stack plots error.  (True for ratio, false for stack)
 /// make more clean maybe?  Maybe?
-TGraphErrors* Plotter::createError(const TH1* error, bool ratio) {
+TGraphErrors* Plotter::createError(const TH1* error, bool ratio, PlotArena& arena) {
   int Nbins =  error->GetXaxis()->GetNbins();
-  Double_t* mcX = new Double_t[Nbins];
-  Double_t* mcY = new Double_t[Nbins];
-  Double_t* mcErrorX = new Double_t[Nbins];
-  Double_t* mcErrorY = new Double_t[Nbins];
-
-  for(int bin=0; bin < error->GetXaxis()->GetNbins(); bin++) {
-    mcY[bin] = (ratio) ? 1.0 : error->GetBinContent(bin+1);
-    mcErrorY[bin] = (ratio) ?  error->GetBinError(bin+1)/error->GetBinContent(bin+1) : error->GetBinError(bin+1);
-    mcX[bin] = error->GetBinCenter(bin+1);
-    mcErrorX[bin] = error->GetBinWidth(bin+1) * 0.5;
+  Double_t* mcX = PlotArena::scratch(0, Nbins);
+  Double_t* mcY = PlotArena::scratch(1, Nbins);
+  Double_t* mcErrorX = PlotArena::scratch(2, Nbins);
+  Double_t* mcErrorY = PlotArena::scratch(3, Nbins);
+
+  double *w, *w2;
+  if(getArrays((TH1*)error, w, w2)) errorBand(w, w2, getEdges(error->GetXaxis()), Nbins, ratio, mcX, mcY, mcErrorX, mcErrorY);
+  else {
+    for(int bin=0; bin < error->GetXaxis()->GetNbins(); bin++) {
+      mcY[bin] = (ratio) ? 1.0 : error->GetBinContent(bin+1);
+      mcErrorY[bin] = (ratio) ?  error->GetBinError(bin+1)/error->GetBinContent(bin+1) : error->GetBinError(bin+1);
+      mcX[bin] = error->GetBinCenter(bin+1);
+      mcErrorX[bin] = error->GetBinWidth(bin+1) * 0.5;
+    }
   }
-  TGraphErrors *mcError = new TGraphErrors(error->GetXaxis()->GetNbins(),mcX,mcY,mcErrorX,mcErrorY);
+  TGraphErrors *mcError = arena.own(new TGraphErrors(error->GetXaxis()->GetNbins(),mcX,mcY,mcErrorX,mcErrorY));
 
   mcError->SetLineWidth(1);
   mcError->SetFillColor(kMagenta+1);
   mcError->SetFillStyle(3004);
 
-  delete[] mcX;
-  delete[] mcY;
-  delete[] mcErrorX;
-  delete[] mcErrorY;
   return mcError;
 }
 
@@ -575,101 +1057,39 @@ TF1* Plotter::createLine(TH1* data_mc) {
   return PrevFitTMP;
 }
 
-//// Monster function here.  Takes a histogram and starts from the left of it
-/// adds up the error in it and finds the ratio of the error to the value.  If
-// this ratio is less than limit value, it takes that bin.  If not, it will move
-/// to the left and add the next bin till the ratio value is less than the limit
-
-///some sort of witchcraft is going on here, may need to check and fix.  The limit
-/// value is not very representative for instance
-vector<double> Plotter::rebinner(const TH1* hist, double limit) {
-  vector<double> bins;
-  double toterror = 0.0, prevbin=0.0;
-  double limit2 = pow(limit,2);
-  bool foundfirst = false;
-  double end;
-
-  //how to tell if ok?
-
-  if(hist->GetEntries() == 0 || hist->Integral() <= 0) return bins;
-
-   for(int i = hist->GetXaxis()->GetNbins(); i > 0; i--) {
-    if(hist->GetBinContent(i) <= 0.0) continue;
-    if(!foundfirst) {
-      bins.push_back(hist->GetXaxis()->GetBinUpEdge(i));
-      foundfirst = true;
-    } else end = hist->GetXaxis()->GetBinLowEdge(i);
-
-    if(toterror* prevbin != 0.) toterror *= pow(prevbin,2)/pow(prevbin+hist->GetBinContent(i),2);
-
-    prevbin += hist->GetBinContent(i);
-    toterror += (2 * pow(hist->GetBinError(i),2))/pow(prevbin,2);
-
-    if(toterror < limit2) {
-      bins.push_back(hist->GetXaxis()->GetBinLowEdge(i));
-      toterror = 0.0;
-      prevbin = 0.0;
-    }
-  }
-
-   ////// makes sure the first bin of the graph is included
-   //// probalby error here (that's why I do a check in the Checkstack
-   /// function, gulp
-  if(bins.back() != end) {
-    bins.push_back(end);
-    if(hist->GetXaxis()->GetXmin() >= 0 && end !=hist->GetXaxis()->GetXmin()) bins.push_back(hist->GetXaxis()->GetXmin());
-  }
-
-  return bins;
-
-}
-
-
 ///// The stack has a list inherently in it, so I made a function to
 /// get the thstacks list and rebin it.  Not necessary, but eh.  Need to
 /// fix delete stuff to stop hs and hsdraw nonsense
-THStack* Plotter::rebinStack(THStack* hs, const double* binner, int total) {
-  THStack* newstack = new THStack(hs->GetName(), hs->GetName());
+THStack* Plotter::rebinStack(THStack* hs, const double* binner, int total, PlotArena& arena) {
+  THStack* newstack = arena.own(new THStack(hs->GetName(), hs->GetName()));
   TList* list = (TList*)hs->GetHists();
 
   TH1D* tmp = (TH1D*)list->First();
   while ( tmp ) {
-    TH1D* forstack = (TH1D*)tmp->Clone();
-    forstack = (TH1D*)forstack->Rebin(total, tmp->GetName(), binner);
-    newstack->Add(forstack);
+    newstack->Add(arena.own((TH1D*)tmp->Rebin(total, tmp->GetName(), binner)));
     tmp = (TH1D*)list->After(tmp);
   }
 
-  hs->Delete();
-
   return newstack;
 }
 
 
-//// Function creates the significance plot on the bottom.
-TList* Plotter::signalBottom(const TList* signal, const TH1D* background) {
-  TList* returnList = new TList();
+//// Function creates the significance plot on the bottom.  The bins are
+/// done in one pass over the arrays (see Significance.h)
+TList* Plotter::signalBottom(const TList* signal, const TH1D* background, PlotArena& arena) {
+  TList* returnList = arena.own(new TList());
+
+  SigEdge edge = (bottomType == SigLeft) ? EdgeLeft : (bottomType == SigRight) ? EdgeRight : EdgeBin;
+  const double* back = background->GetArray();
+  const double* backw2 = (background->GetSumw2N() > 0) ? background->GetSumw2()->GetArray() : back;
 
   TH1D* holder = (TH1D*)signal->First();
 
   while(holder) {
-    TH1D* signif = (TH1D*)holder->Clone();
-    int Nbins = signif->GetXaxis()->GetNbins();
-    for(int i = 0; i < Nbins;i++) {
-      if(signif->GetBinContent(i+1) <= 0 && background->GetBinContent(i+1) <= 0) continue;
-      int edge1 = i+1, edge2= i+1;
-      double sigErr, backErr;
-      if(bottomType == SigLeft) edge1 = 0;
-      if(bottomType == SigRight) edge2 = Nbins;
-      double sigInt = signif->IntegralAndError(edge1, edge2, sigErr);
-      double backInt = background->IntegralAndError(edge1, edge2, backErr);
-
-      double total = (ssqrtsb) ? sigInt/sqrt(sigInt+backInt) : sigInt/sqrt(backInt);
-      double perErr = (ssqrtsb) ? pow(sigErr/sigInt-sigErr/(2*(sigInt+backInt)),2) + pow(backErr/(2*(sigInt+backInt)),2) : pow(sigErr/sigInt,2) + pow(backErr/(2*backInt),2);
-
-      signif->SetBinContent(i+1, total);
-      signif->SetBinError(i+1, total*perErr);
-    }
+    TH1D* signif = arena.own((TH1D*)holder->Clone());
+    if(signif->GetSumw2N() == 0) signif->Sumw2();
+    computeSignificance(sigFormula, edge, signif->GetArray(), signif->GetSumw2()->GetArray(),
+			back, backw2, signif->GetXaxis()->GetNbins());
     returnList->Add(signif);
     holder = (TH1D*)signal->After(holder);
   }
@@ -678,23 +1098,33 @@ TList* Plotter::signalBottom(const TList* signal, const TH1D* background) {
 }
 
 
-//// Function creates the Ratio Plot on the bottom
-TList* Plotter::signalBottom(const TList* signal, const TH1D* data, const TH1D* background) {
-  TList* returnList = new TList();
+//// Function creates the Ratio Plot on the bottom.  data/(signal+background)
+/// for each signal and data/background, on the arrays (see PlotKernels.h)
+TList* Plotter::signalBottom(const TList* signal, const TH1D* data, const TH1D* background, PlotArena& arena) {
+  TList* returnList = arena.own(new TList());
+
+  int nbins = data->GetXaxis()->GetNbins();
+  double *dataw, *dataw2, *backw, *backw2, *w, *w2;
+  bool arrays = getArrays((TH1*)data, dataw, dataw2) && getArrays((TH1*)background, backw, backw2);
 
   TH1D* holder = (TH1D*)signal->First();
 
   while(holder) {
-    TH1D* total = (TH1D*)holder->Clone();
-    total->Add(background);
-
-    total->Divide(data, total);
+    TH1D* total = arena.own((TH1D*)holder->Clone());
+    if(arrays && getArrays(total, w, w2)) {
+      addBins(w, w2, backw, backw2, nbins);
+      divideBins(dataw, dataw2, w, w2, w, w2, nbins);
+    } else {
+      total->Add(background);
+      total->Divide(data, total);
+    }
 
     returnList->Add(total);
     holder = (TH1D*)signal->After(holder);
   }
-  TH1D* data_mc = (TH1D*)data->Clone();
-  data_mc->Divide(background);
+  TH1D* data_mc = arena.own((TH1D*)data->Clone());
+  if(arrays && getArrays(data_mc, w, w2)) divideBins(w, w2, backw, backw2, w, w2, nbins);
+  else data_mc->Divide(background);
   returnList->Add(data_mc);
 
   holder = NULL;
@@ -721,8 +1151,9 @@ void Plotter::setYAxisTop(TH1* datahist, TH1* error, double ratio, THStack* hs)
   }
   t = x_axis_name.c_str();
 
-  //when Divide bin option and fixed bin size option is given
-  if(styler.getDivideBins() && styler.getRebinLimit() >1.0) {
+  //when Divide bin option and fixed bin size option is given.  RebinFactor
+  /// bins are fixed too, and never divided by the width
+  if((styler.getDivideBins() && styler.getRebinLimit() >1.0) || styler.getRebinFactor() > 1) {
     double bin_width = datahist->GetBinWidth(1);
     double nearest= round(bin_width * 100) / 100;
     std::string s = std::to_string(nearest);
@@ -760,7 +1191,11 @@ void Plotter::setYAxisTop(TH1* datahist, TH1* error, double ratio, THStack* hs)
   else {
     yaxis->SetTitle("Events");}
   ///  yaxis->SetLabelSize(hs->GetXaxis()->GetLabelSize());
-  double max = (error->GetMaximum() > datahist->GetMaximum()) ? error->GetMaximum() : datahist->GetMaximum();
+  //// after the rebinning, so the summaries can't be used.  One scan each
+  double *w, *w2;
+  double errormax = (getArrays(error, w, w2)) ? maxBin(w, error->GetXaxis()->GetNbins()) : error->GetMaximum();
+  double datamax = (getArrays(datahist, w, w2)) ? maxBin(w, datahist->GetXaxis()->GetNbins()) : datahist->GetMaximum();
+  double max = (errormax > datamax) ? errormax : datamax;
 
    hs->SetMaximum(max*(1.0/ratio + 1.0));
 
@@ -779,10 +1214,14 @@ void Plotter::setXAxisBot(TH1* data_mc, double ratio) {
 void Plotter::setYAxisBot(TAxis* yaxis, TH1* data_mc, double ratio) {
   double divmin = 0.0, divmax = 2.99;
   double low=2.99, high=0.0, tmpval;
-  for(int i = 0; i < data_mc->GetXaxis()->GetNbins(); i++) {
-    tmpval = data_mc->GetBinContent(i+1);
-    if(tmpval < 2.99 && tmpval > high) {high = tmpval;}
-    if(tmpval > 0. && tmpval < low) {low = tmpval;}
+  double *w, *w2;
+  if(getArrays(data_mc, w, w2)) ratioWindow(w, data_mc->GetXaxis()->GetNbins(), 2.99, low, high);
+  else {
+    for(int i = 0; i < data_mc->GetXaxis()->GetNbins(); i++) {
+      tmpval = data_mc->GetBinContent(i+1);
+      if(tmpval < 2.99 && tmpval > high) {high = tmpval;}
+      if(tmpval > 0. && tmpval < low) {low = tmpval;}
+    }
   }
   double val = min(abs(1 / (high - 1.)), abs(1 / (1/low -1.)));
   if(high == 0.0) val = 0;
@@ -803,9 +1242,11 @@ void Plotter::setYAxisBot(TAxis* yaxis, TH1* data_mc, double ratio) {
 /// changes the range to fit all of the graphs
 void Plotter::setYAxisBot(TAxis* yaxis, TList* signal, double ratio) {
   double max = 0;
+  double *w, *w2;
   TH1D* tmphist = (TH1D*)signal->First();
   while(tmphist) {
-    max = (max < tmphist->GetMaximum()) ? tmphist->GetMaximum() : max;
+    double histmax = (getArrays(tmphist, w, w2)) ? maxBin(w, tmphist->GetXaxis()->GetNbins()) : tmphist->GetMaximum();
+    max = (max < histmax) ? histmax : max;
     tmphist = (TH1D*)signal->After(tmphist);
   }
 
@@ -813,58 +1254,78 @@ void Plotter::setYAxisBot(TAxis* yaxis, TList* signal, double ratio) {
   yaxis->SetLabelSize(yaxis->GetLabelSize()*ratio);
   yaxis->SetTitleSize(ratio*yaxis->GetTitleSize());
   yaxis->SetTitleOffset(yaxis->GetTitleOffset()/ratio);
-  if(ssqrtsb) yaxis->SetTitle("#frac{S}{#sqrt{S+B}}");
-  else  yaxis->SetTitle("#frac{S}{#sqrt{B}}");
+  if(sigFormula == AsimovZ) yaxis->SetTitle("Z_{A}");
+  else if(sigFormula == SOverSqrtB) yaxis->SetTitle("#frac{S}{#sqrt{B}}");
+  else yaxis->SetTitle("#frac{S}{#sqrt{S+B}}");
 }
 
 
 //// divdes all of the histogram by their width if told to by the style config file
 /// namely with the value DivideBins
 void Plotter::divideBin(TH1* data, TH1* error, THStack* hs, TList* signal) {
-  //bu asagidaki kismi ben comment  ettim
-
-  for(int i = 0; i < data->GetXaxis()->GetNbins(); i++) {
-    data->SetBinContent(i+1, data->GetBinContent(i+1)/data->GetBinWidth(i+1));
-    data->SetBinError(i+1, data->GetBinError(i+1)/data->GetBinWidth(i+1));
-  }
-  for(int i = 0; i < error->GetXaxis()->GetNbins(); i++) {
-    error->SetBinContent(i+1, error->GetBinContent(i+1)/error->GetBinWidth(i+1));
-    error->SetBinError(i+1, error->GetBinError(i+1)/error->GetBinWidth(i+1));
-  //bu yukaridaki kismi ben comment  ettim
-//burdan itiabren ben ekledim
-  //buraya kadar ben ekledim yukaridaki kismi comment ettiktan sonra.
-  // for(int i = 0; i < data->GetXaxis()->GetNbins(); i++) {
-  //   data->SetBinContent(i+1, data->GetBinContent(i+1));
-  //   data->SetBinError(i+1, data->GetBinError(i+1));
-  // }
-  // for(int i = 0; i < error->GetXaxis()->GetNbins(); i++) {
-  //   error->SetBinContent(i+1, error->GetBinContent(i+1));
-  //   error->SetBinError(i+1, error->GetBinError(i+1));
-   }
+  divideWidth(data);
+  divideWidth(error);
 
   TList* list = (TList*)hs->GetHists();
 
   TIter next(list);
   TH1* tmp = NULL;
-  while ( (tmp = (TH1*)next()) ) {
-    for(int i = 0; i < tmp->GetXaxis()->GetNbins(); i++) {
-      tmp->SetBinContent(i+1,tmp->GetBinContent(i+1)/tmp->GetBinWidth(i+1));
-      //tmp->SetBinContent(i+1,tmp->GetBinContent(i+1));
-      //tmp->SetBinError(i+1,tmp->GetBinError(i+1));
-      tmp->SetBinError(i+1,tmp->GetBinError(i+1)/tmp->GetBinWidth(i+1));
-    }
-  }
+  while ( (tmp = (TH1*)next()) ) divideWidth(tmp);
+
   tmp = (TH1*)signal->First();
   while(tmp) {
-    for(int i = 0; i < tmp->GetXaxis()->GetNbins(); i++) {
-      tmp->SetBinContent(i+1,tmp->GetBinContent(i+1)/tmp->GetBinWidth(i+1));
-      tmp->SetBinError(i+1,tmp->GetBinError(i+1)/tmp->GetBinWidth(i+1));
-    }
+    divideWidth(tmp);
     tmp = (TH1*)signal->After(tmp);
   }
 
 }
 
+//// one histogram of divideBin.  TH1D goes through the kernel, anything
+/// else bin by bin
+void Plotter::divideWidth(TH1* hist) {
+  double *w, *w2;
+  if(getArrays(hist, w, w2)) {
+    divideByWidth(w, w2, getEdges(hist->GetXaxis()), hist->GetXaxis()->GetNbins());
+    return;
+  }
+  for(int i = 0; i < hist->GetXaxis()->GetNbins(); i++) {
+    hist->SetBinContent(i+1, hist->GetBinContent(i+1)/hist->GetBinWidth(i+1));
+    hist->SetBinError(i+1, hist->GetBinError(i+1)/hist->GetBinWidth(i+1));
+  }
+}
+
+//// Contents and sumw2 of a TH1D for the kernels in PlotKernels.h (the
+/// sumw2 is made if it isn't there).  False for any other kind of
+/// histogram, those have to use the TH1 calls
+bool Plotter::getArrays(TH1* hist, double*& w, double*& w2) {
+  if(hist->IsA() != TH1D::Class()) return false;
+  if(hist->GetSumw2N() == 0) hist->Sumw2();
+  w = ((TH1D*)hist)->GetArray();
+  w2 = hist->GetSumw2()->GetArray();
+  return true;
+}
+
+//// sum->Add(hist) on the arrays when both are TH1D with the same
+/// number of bins.  Entries are left to the caller
+void Plotter::addHist(TH1* sum, TH1* hist) {
+  double *sumw, *sumw2, *w, *w2;
+  if(sum->GetXaxis()->GetNbins() == hist->GetXaxis()->GetNbins() && getArrays(sum, sumw, sumw2) && getArrays(hist, w, w2)) {
+    addBins(sumw, sumw2, w, w2, sum->GetXaxis()->GetNbins());
+  }
+  else sum->Add(hist);
+}
+
+//// nbins+1 edges of the axis.  Fixed bins are worked out into a scratch
+/// array of the thread, good until the next call
+const double* Plotter::getEdges(const TAxis* axis) {
+  int nbins = axis->GetNbins();
+  if(axis->GetXbins()->GetSize() == nbins + 1) return axis->GetXbins()->GetArray();
+
+  double* edges = PlotArena::scratch(4, nbins + 1);
+  for(int i = 0; i <= nbins; i++) edges[i] = axis->GetBinLowEdge(i+1);
+  return edges;
+}
+
 
 //// get the number of files total in the plotter
 int Plotter::getSize() {
@@ -911,204 +1372,108 @@ void Plotter::setStyle(Style& style) {
 }
 
 
-/// Add Normalized file to plotter
+/// Add Normalized file to plotter.  Normalizes the group first if that
+/// hasn't been done already (ie by addFiles)
 void Plotter::addFile(Normer& norm) {
-  string filename = norm.output;
+  string filename = norm.getFilename();
   if(norm.use == 0) {
     cout << filename << ": Not all files found" << endl << endl;
     return;
   }
 
-  while(filename.find("#") != string::npos) {
-    filename.erase(filename.find("#"), 1);
-  }
-
-  TFile* normedFile = NULL;
-  if(norm.use == 1) {
-    norm.print();
-    norm.FileList = new TList();
-    for(vector<string>::iterator name = norm.input.begin(); name != norm.input.end(); ++name) {
-      norm.FileList->Add(TFile::Open(name->c_str()));
-    }
-
-    normedFile = new TFile(filename.c_str(), "RECREATE");
-    norm.MergeRootfile(normedFile);
-  } else if(norm.use == 2) {
-    cout << filename << " is already Normalized" << endl << endl;;
-    normedFile = new TFile(filename.c_str());
+  if(norm.normedFile == NULL) {
+    if(norm.use == 1) norm.print();
+    else if(norm.use == 2) cout << filename << " is already Normalized" << endl << endl;
+    norm.Normalize();
   }
 
+  TFile* normedFile = norm.normedFile;
   normedFile->SetTitle(norm.output.c_str());
 
-  if(norm.type == "data") FileList[0]->Add(normedFile);
-  else if(norm.type == "bg") FileList[1]->Add(normedFile);
-  else if(norm.type == "sig") FileList[2]->Add(normedFile);
+  int i = -1;
+  if(norm.type == "data") i = 0;
+  else if(norm.type == "bg") i = 1;
+  else if(norm.type == "sig") i = 2;
+  if(i < 0) return;
 
+  FileList[i]->Add(normedFile);
+  stores[i].push_back(norm.store);
+  summaries[i].push_back(norm.summary);
 
-}
 
-void Plotter::getPresetBinning(string filename) {
-
-  ifstream info_file(filename);
+}
 
-  if(!info_file) {
-    std::cout << "could not open file " << filename <<std::endl;
-    exit(1);
+/// Normalizes all of the groups using nworkers threads, then adds them
+/// to the plotter in the order given.  Groups are started biggest first
+/// (total bytes of the input files) so one big group started at the end
+/// doesn't hold everything up.  Prints how long each group took
+void Plotter::addFiles(vector<Normer*> norms, int nworkers) {
+  //// biggest groups first.  The sizes stat every input, so each group
+  /// is only looked at once
+  vector<pair<Long64_t, Normer*>> sized;
+  for(auto norm: norms) {
+    if(norm->use == 0 || norm->normedFile != NULL) continue;
+    if(norm->store == NULL) norm->store = HistStore::create(storeType);
+    sized.push_back(make_pair(norm->getInputSize(), norm));
   }
-
-  string line;
-  while(getline(info_file, line)) {
-    string name;
-    vector<string> tmpVals;
-    vector<pair<int, double>> tmpPairs;
-    string current = "";
-    int bracNum = 0;
-    for(auto it: line) {
-      if(it == '[' || it == ']' || it == ',') {
-	if(current != "") {
-	  if(bracNum == 0) name = current;
-	  else if(bracNum > 0) tmpVals.push_back(current);
-	  current = "";
-	}
-	if(it == '[' && ++bracNum > 2) {
-	  cout << "Error: Current code only allows for 2 levels of brackets.  Review line:" << endl;
-	  cout << line << endl;
-	  exit(1);
-	} else if(it == ']') {
-	  if(--bracNum < 0 || (tmpVals.size() != 2 && tmpVals.size() != 0)) {
-	    cout << "Error: Closing Bracket without corresponding open bracket: Review line:" << endl;
-	    cout << line << endl;
-	    exit(1);
-	  }
-	  if(tmpVals.size() == 2) tmpPairs.push_back(make_pair(stoi(tmpVals.at(0)), stod(tmpVals.at(1))));
-	  tmpVals.clear();
-	}
-      } else if(it == ' ' || it == '\t') continue;
-      else current.push_back(it);
-    }
-
-    if(bracNum != 0) {
-      cout << "Error: Not all Brackets were terminated.  Please review the line:" << endl;
-      cout << line << endl;
-      exit(1);
-    } // else if(e1.size()*e2.size() != 0) {
-    //   cout << "Error: Input requires all inputs to be enclosed by brackets. Review line:" << endl;
-    //   cout << line << endl;
-    //   exit(1);
-    // }
-    if(explicitBins.find(name) != explicitBins.end()) {
-      cout << "Duplicate histogram:" << endl;
-      cout << name << endl;
-      exit(1);
-    }
-    explicitBins[name] = tmpPairs;
+  stable_sort(sized.begin(), sized.end(), [](const pair<Long64_t, Normer*>& a, const pair<Long64_t, Normer*>& b) {
+      return a.first > b.first;
+    });
+  vector<Normer*> schedule;
+  for(auto& group: sized) schedule.push_back(group.second);
+
+  bool threaded = nworkers > 1 && schedule.size() > 1;
+  if(threaded) cout << "Normalizing " << schedule.size() << " groups with " << nworkers << " workers" << endl << endl;
+  for(auto norm: schedule) threaded = threaded || norm->inputWorkers > 1 || norm->dirWorkers > 1;
+
+  //// gDirectory is per thread after this, so the cd's in MergeRootfile
+  /// don't step on each other
+  if(threaded) ROOT::EnableThreadSafety();
+
+  for(auto norm: schedule) {
+    if(norm->use == 1) norm->print();
+    else if(norm->use == 2) cout << norm->getFilename() << " is already Normalized" << endl << endl;
   }
-  info_file.close();
 
-}
+  //// AddDirectory is global, not per thread, so set it once here instead of
+  /// letting each MergeRootfile flip it back and forth
+  Bool_t status = TH1::AddDirectoryStatus();
+  TH1::AddDirectory(kFALSE);
 
+  mutex printLock;
+  WorkerPool pool(nworkers);
+  pool.run(schedule.size(), [&](int i) {
+      schedule.at(i)->Normalize();
+      lock_guard<mutex> lock(printLock);
+      cout << schedule.at(i)->getFilename() << ": normalized in " << to_string_with_precision(schedule.at(i)->normTime, 1) << " s" << endl;
+    });
+  if(schedule.size() > 0) cout << ReadPlanner::getStats() << endl;
+  ReadPlanner::resetStats();
 
+  TH1::AddDirectory(status);
 
+  for(auto norm: norms) addFile(*norm);
 
-//// A lot of regex stuff to extract the x axis label from the title
-// of the graph.  If the xaxis label is wrong, change the code here.
-string Plotter::newLabel(string stringkey) {
-  string particle = "";
-
-  smatch m;
-  regex part ("(Di)?(Tau(Jet)?|Muon|Electron|Jet)");
-
-  regex e ("^(.+?)(1|2)?Energy$");
-  regex n ("^N(.+)$");
-  regex charge ("^(.+?)(1|2)?Charge");
-  regex mass ("(.+?)(Not)?Mass");
-  regex zeta ("(.+?)(P)?Zeta(1D|Vis)?");
-  regex deltar ("(.+?)DeltaR");
-  regex MetMt ("^(([^_]*?)(1|2)|[^_]+_(.+?)(1|2))MetMt$");
-  regex eta ("^(.+?)(Delta)?(Eta)");
-  regex phi ("^(([^_]*?)|[^_]+_(.+?))(Delta)?(Phi)");
-  regex cosdphi ("(.+?)(CosDphi)(.*)");
-  regex pt ("^(.+?)(Delta)?(Pt)(Div)?.*$");
-  regex osls ("^(.+?)OSLS");
-  regex zdecay ("^[^_]_(.+)IsZdecay$");
-
-
-  if(regex_match(stringkey, m, e)) {
-    return "E(" + turnLatex(m[1].str()) + ") [GeV]";
-  }
-  else if(regex_match(stringkey, m, n)) {
-    return "N(" + turnLatex(m[1].str()) + ")";
-  }
-  else if(regex_match(stringkey, m, charge)) {
-    return  "charge(" + turnLatex(m[1].str())+ ") [e]";
-  }
-  else if(regex_match(stringkey, m, mass)) {
-    return ((m[2].str() == "Not") ? "Not Reconstructed M(": "M(") + listParticles(m[1].str()) + ") [GeV]";
-  }
-  else if(regex_match(stringkey, m, zeta)) {
-    return m[2].str() + "#zeta" +((m[3].str() != "") ? "_{" + m[3].str() + "}":"") + "(" + listParticles(m[1].str()) + ")";
-  }
-  else if(regex_match(stringkey, m, deltar)) {
-    return "#DeltaR("+ listParticles(m[1].str()) + ")";
-  }
-  else if(regex_match(stringkey, m, MetMt)) {
-    return "M_{T}(" + turnLatex(m[2].str()+m[4].str()) + ") [GeV]";
-  }
-  else if(regex_match(stringkey, m, eta))  {
-    particle += (m[2].str() != "") ? "#Delta" : "";
-    particle += "#eta(" + listParticles(m[1].str()) + ")";
-    return particle;
-  }
-  else if(regex_match(stringkey, m, phi))  {
-    if(m[4].str() != "") particle = "#Delta";
-    particle += "#phi(" + listParticles(m[2].str()+m[3].str()) + ")";
-    return particle;
-  }
-  else if(regex_match(stringkey, m, cosdphi)) {
-    return "cos(#Delta#phi(" + listParticles(m[1].str()) + "))";
-  }
-  else if(regex_match(stringkey, m, pt)) {
-    if(m[4].str() != "") particle += "#frac{#Delta p_{T}}{#Sigma p_{T}}(";
-    else if(m[2] != "") particle += "#Delta p_{T}(";
-    else particle += "p_{T}(";
-    particle += listParticles(m[1].str()) + ") [GeV]";
-    return particle;
-  }
-  else if(stringkey.find("Met") != string::npos) return "#slash{E}_{T} [GeV]";
-  else if(stringkey.find("MHT") != string::npos) return "#slash{H}_{T} [GeV]";
-  else if(stringkey.find("HT") != string::npos) return "H_{T} [GeV]";
-  else if(stringkey.find("Meff") != string::npos) return "M_{eff} [GeV]";
-  else if(regex_match(stringkey, m, osls)) {
-    particle = m[1].str();
-    string full = "";
-    while(regex_search(particle, m, part)) {
-      full += "q_{" + turnLatex(m[0].str()) + "} ";
-      particle = m.suffix().str();
+  if(storeType != "") {
+    size_t total = 0;
+    for(int i = 0; i < 3; i++) {
+      for(auto store: stores[i]) total += (store) ? store->getBytes() : 0;
     }
-    return full;
-  } else if(regex_match(stringkey, m, zdecay)) {
-    return listParticles(m[1].str()) + "is Z Decay";
+    cout << "Histogram store (" << storeType << "): " << to_string_with_precision(total/1048576., 1) << " MB" << endl;
   }
+}
 
-  return stringkey;
+void Plotter::getPresetBinning(string filename) {
+  rebinner.readSpecs(filename);
+}
 
+
+//// x axis label from the title of the graph.  The rules are in
+/// style/labels (see LabelMaker), change the labels there
+string Plotter::newLabel(string stringkey) {
+  return labeler.getLabel(stringkey);
 }
 
-////// helper function for newLabel.  Takes a section of the string
-/// and extracts the particles from it, then turns them into latex format.
-/// seperated by comma
-//// More robust would be vector<string> so could use different formatting
-string Plotter::listParticles(string toParse) {
-  smatch m;
-  regex part ("(Di)?(Tau(Jet)?|Muon|Electron|Jet|Met)");
-  bool first = true;
-  string final = "";
-
-  while(regex_search(toParse,m,part)) {
-    if(first) first = false;
-    else final += ", ";
-    final += turnLatex(m[0].str());
-    toParse = m.suffix().str();
-  }
-  return final;
+void Plotter::readLabelRules(string filename) {
+  labeler.readRules(filename);
 }
@@ -45,6 +45,10 @@ about the graph are more important.
 #include <time.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <unordered_map>
 #include "tokenizer.hpp"
 #include <fstream>
@@ -55,11 +59,25 @@ about the graph are more important.
 #include <sstream>
 #include <iomanip>
 #include <regex>
+#include <mutex>
+#include <atomic>
+#include <map>
+#include <functional>
+#include <algorithm>
 
 
 #include "Normalizer.h"
 #include "Style.h"
 #include "Logfile.h"
+#include "WorkerPool.h"
+#include "HistIndex.h"
+#include "Significance.h"
+#include "PlotKernels.h"
+#include "Rebinner.h"
+#include "PlotArena.h"
+#include "LabelMaker.h"
+#include "NormCache.h"
+#include "ReadPlanner.h"
 
 
 enum Bottom {SigLeft, SigRight, SigBoth, SigBin, Ratio};
@@ -72,18 +90,49 @@ class Plotter {
  public:
   void CreateStack( TDirectory*, Logfile&); ///fix plot stuff
   void addFile(Normer&);
+  void addFiles(vector<Normer*>, int nworkers=1);
 
   int getSize();
   vector<string> getFilenames(string option="all");
   void setStyle(Style&);
   void setBottomType(Bottom input) {bottomType = input;}
-  void setSignificanceSSqrtB() {ssqrtsb = false;}
+  void setSignificanceSSqrtB() {sigFormula = SOverSqrtB;}
+  void setSignificanceAsimov() {sigFormula = AsimovZ;}
   void setNoBottom() {onlyTop = true;}
+  void setStore(string type) {storeType = type;}
+  void setPlotWorkers(int n) {plotWorkers = (n < 1) ? 1 : n;}
+  void setPlotProcs(int n) {plotProcs = (n < 1) ? 1 : n;}
+  void setShard(int i, int n) {shard = i; nshards = n;}
+  void setMergeShards() {mergeOnly = true;}
+  void setSpool(string dir) {spoolDir = dir;}
+  void setFilter(const PathFilter* pathfilter) {filter = (pathfilter->empty()) ? NULL : pathfilter;}
+  static string getShardName(const string&, int);
   void getPresetBinning(string);
+  void readLabelRules(string);
 
 
  private:
   TList* FileList[3] = {new TList(), new TList(), new TList()};
+  HistIndex* histIndex = NULL;
+  vector<HistStore*> stores[3];
+  vector<SummaryIndex*> summaries[3];
+  atomic<int> skippedEmpty{0};   //// plots isEmptyPlot saved from reading
+  string storeType = "";
+  int plotWorkers = 1, plotProcs = 1;
+  int shard = -1, nshards = 0;
+  bool mergeOnly = false;
+  string spoolDir = "";
+  const PathFilter* filter = NULL;
+  static const int spoolBatch = 16;   //// plan items per spool batch
+  mutex readLock;
+  //// planned reads (planReads): names the plots being made read from each
+  /// directory in plan order, how many more times each key will be read
+  /// and what has been read ahead but not used yet
+  unordered_map<string, vector<string>> plannedNames;
+  unordered_map<string, int> plannedPlace;
+  unordered_map<TKey*, int> plannedUses;
+  unordered_map<TKey*, TH1*> readAhead;
+  static const Long64_t readAheadBytes = 64*1024*1024;   //// most read ahead at once (uncompressed)
   Style styler;
   // int color[9] = {100, 90, 80, 70, 60, 50, 40, 30, 20};
 
@@ -94,12 +143,48 @@ class Plotter {
  // int color[9] = {kBlue-9, 432-9, 23, kOrange+6, kRed-7, kYellow-9, kGreen-10, kPink-8, kMagenta};
  int color[16] = {kRed, kOrange+1, kYellow-7, kGreen+1, kBlue-4, kViolet-9, kMagenta+1, kAzure+10, kRed-9, kYellow-3, kCyan-9, kGreen+2,  kAzure+1, kViolet-1, kRed-7, kGreen-8};
 
- bool ssqrtsb = true, onlyTop = false;
+ bool onlyTop = false;
+  SigFormula sigFormula = SOverSqrtSB;
   Bottom bottomType = Ratio;
-  static unordered_map<string, string> latexer;
+
+  TH1* readHist(int, int, const string&, const string&, TKey*);
+  string getReadPath(const string&, const string&, int&);
+
+  //// Everything that goes on the canvas of one plot
+  struct PlotPieces {
+    TH1* readObj;
+    TH1D *datahist, *error;
+    TList *sigHists, *signalBot;
+    THStack* hsdraw;
+    TGraphErrors *errorstack, *errorratio;
+    PlotArena* arena;   //// owns all of the above
+  };
+  //// One thing written to the output, in order: the cutflow line of a
+  /// directory (empty name) or a plot
+  struct PlotItem {
+    TDirectory* target;
+    string path, name;
+  };
+  void planStack(TDirectory*, const string&, vector<PlotItem>&);
+  bool hasPlots(const string&);
+  vector<string> getCutflow(TDirectory*, const string&);
+  void renderForked(TDirectory*, const vector<PlotItem>&, Logfile&);
+  void renderShard(TFile*, const vector<PlotItem>&, int, int);
+  void mergeShards(const vector<PlotItem>&, const string&, Logfile&, bool);
+  void renderItems(TFile*, const vector<PlotItem>&, int, int, int, ostream&);
+  void planReads(const vector<PlotItem>&, int, int, int);
+  void clearReads();
+  void readCutflows(istream&, map<int, vector<string>>&);
+  void copyItems(const vector<PlotItem>&, const vector<TFile*>&, function<int(int)>, map<int, vector<string>>&, Logfile&);
+  string getSpoolName(int);
+  string getSpoolOwner();
+  void checkSpoolPlan(const vector<PlotItem>&);
+  void runSpool(const vector<PlotItem>&);
+  void mergeSpool(const vector<PlotItem>&, Logfile&);
+  PlotPieces* buildPlot(const string&, const string&, TKey*);
+  void drawPlot(TDirectory*, PlotPieces*, string keyname="");
 
   string newLabel(string);
-  string listParticles(string);
   void setXAxisTop(TH1*, TH1*, THStack*);
   void setYAxisTop(TH1*, TH1*, double, THStack*);
   void setXAxisBot(TH1*, double);
@@ -107,21 +192,26 @@ class Plotter {
   void setYAxisBot(TAxis*, TList*, double);
 
   TH1D* printBottom(TH1D*, TH1D*);
-  TList* signalBottom(const TList*, const TH1D*);
-  TList* signalBottom(const TList*, const TH1D*, const TH1D*);
+  TList* signalBottom(const TList*, const TH1D*, PlotArena&);
+  TList* signalBottom(const TList*, const TH1D*, const TH1D*, PlotArena&);
 
-  THStack* sortStack(THStack*);
-  TLegend* createLeg(const TH1*, const TList*, const TList*);
-  TGraphErrors* createError(const TH1*, bool);
+  THStack* sortStack(THStack*, const vector<double>&, PlotArena&);
+  bool isEmptyPlot(const string&, const string&);
+  TLegend* createLeg(const TH1*, const TList*, const TList*, PlotArena&);
+  TGraphErrors* createError(const TH1*, bool, PlotArena&);
   void sizePad(double, TVirtualPad*, bool);
   TF1* createLine(TH1*);
 
-  vector<double> rebinner(const TH1*, double);
-
-  unordered_map<string, vector<pair<int, double>>> explicitBins;
+  Rebinner rebinner;
+  LabelMaker labeler;
 
-  THStack* rebinStack(THStack*, const double*, int);
+  THStack* rebinStack(THStack*, const double*, int, PlotArena&);
   void divideBin(TH1*, TH1*,THStack*, TList*);
+
+  static bool getArrays(TH1*, double*&, double*&);
+  static void addHist(TH1*, TH1*);
+  static const double* getEdges(const TAxis*);
+  static void divideWidth(TH1*);
 };
 
 #endif
@@ -0,0 +1,208 @@
+#include "ReadPlanner.h"
+
+using namespace std;
+
+const Long64_t ReadPlanner::maxGap;
+const Long64_t ReadPlanner::maxChunk;
+const Long64_t ReadPlanner::maxUnzip;
+int ReadPlanner::unzipWorkers = 0;
+atomic<long> ReadPlanner::keysRead(0), ReadPlanner::readCalls(0), ReadPlanner::bytesRead(0), ReadPlanner::gapBytes(0),
+  ReadPlanner::fallbacks(0), ReadPlanner::unzipped(0);
+atomic<long long> ReadPlanner::seekGiven(0), ReadPlanner::seekPlanned(0);
+
+//// Reads all of the keys (all from one file) in offset order, see
+/// ReadPlanner.h
+void ReadPlanner::read(const vector<TKey*>& keys, function<void(int, TObject*)> take) {
+  vector<int> order;
+  TKey* last = NULL;
+  for(int k = 0; k < keys.size(); k++) {
+    if(!keys.at(k)) continue;
+    if(last) seekGiven += llabs(keys.at(k)->GetSeekKey() - getEnd(last));
+    last = keys.at(k);
+    order.push_back(k);
+  }
+  if(order.empty()) return;
+  stable_sort(order.begin(), order.end(), [&](int a, int b) {return keys.at(a)->GetSeekKey() < keys.at(b)->GetSeekKey();});
+
+  vector<char> buffer;
+  Long64_t lastStop = -1;
+  int begin = 0;
+  while(begin < order.size()) {
+    Long64_t start = keys.at(order.at(begin))->GetSeekKey();
+    Long64_t stop = getEnd(keys.at(order.at(begin)));
+    int end = begin + 1;
+    for(; end < order.size(); end++) {
+      TKey* next = keys.at(order.at(end));
+      Long64_t nextStop = max(stop, getEnd(next));
+      if(next->GetSeekKey() - stop > maxGap || nextStop - start > maxChunk) break;
+      stop = nextStop;
+    }
+    if(lastStop >= 0) seekPlanned += llabs(start - lastStop);
+    lastStop = stop;
+
+    readChunk(keys, order, begin, end, start, stop, buffer, take);
+    begin = end;
+  }
+}
+
+//// One ReadBuffer for keys order[begin] to order[end-1] (bytes start to
+/// stop of the file), then each object is made from its part of it
+void ReadPlanner::readChunk(const vector<TKey*>& keys, const vector<int>& order, int begin, int end, Long64_t start, Long64_t stop,
+			    vector<char>& buffer, function<void(int, TObject*)>& take) {
+  TFile* file = keys.at(order.at(begin))->GetFile();
+  Long64_t length = stop - start;
+  if(buffer.size() < length) buffer.resize(length);
+
+  //// ReadBuffer is true if it failed
+  bool failed = file->ReadBuffer(buffer.data(), start, (Int_t)length);
+  if(!failed) {
+    readCalls++;
+    bytesRead += length;
+    gapBytes += length;
+    for(int n = begin; n < end; n++) gapBytes -= keys.at(order.at(n))->GetNbytes();
+  }
+  if(!failed && unzipWorkers > 0) {
+    unzipChunk(keys, order, begin, end, start, buffer, take);
+    return;
+  }
+
+  for(int n = begin; n < end; n++) {
+    int k = order.at(n);
+    TKey* key = keys.at(k);
+    TObject* object = (failed) ? NULL : key->ReadObjWithBuffer(buffer.data() + (key->GetSeekKey() - start));
+    if(!object) object = readAlone(key);
+    keysRead++;
+    take(k, object);
+  }
+}
+
+//// Same as the loop at the end of readChunk, but the histograms are
+/// decompressed by the unzip workers first, a batch of up to maxUnzip
+/// bytes at a time.  The objects are made here, in file order
+void ReadPlanner::unzipChunk(const vector<TKey*>& keys, const vector<int>& order, int begin, int end, Long64_t start,
+			     vector<char>& buffer, function<void(int, TObject*)>& take) {
+  WorkerPool pool(unzipWorkers);
+  int first = begin;
+  while(first < end) {
+    int last = first;
+    Long64_t size = 0;
+    while(last < end && (last == first || size + keys.at(order.at(last))->GetObjlen() <= maxUnzip)) {
+      size += keys.at(order.at(last))->GetObjlen();
+      last++;
+    }
+
+    //// only histograms, the class is looked up here since TClass isn't
+    /// thread safe without EnableThreadSafety
+    vector<vector<char>> records(last - first);
+    vector<char> done(last - first, 0);
+    for(int b = 0; b < last - first; b++) {
+      TClass* cl = TClass::GetClass(keys.at(order.at(first + b))->GetClassName());
+      done.at(b) = cl && cl->InheritsFrom(TH1::Class());
+    }
+    pool.run(last - first, [&](int b) {
+	TKey* key = keys.at(order.at(first + b));
+	if(done.at(b)) done.at(b) = unzip(key, buffer.data() + (key->GetSeekKey() - start), records.at(b));
+      });
+
+    for(int b = 0; b < last - first; b++) {
+      int k = order.at(first + b);
+      TKey* key = keys.at(k);
+      TObject* object = NULL;
+      if(done.at(b)) {
+	object = stream(key, records.at(b));
+	if(object) unzipped++;
+      } else {
+	object = key->ReadObjWithBuffer(buffer.data() + (key->GetSeekKey() - start));
+      }
+      vector<char>().swap(records.at(b));
+      if(!object) object = readAlone(key);
+      keysRead++;
+      take(k, object);
+    }
+    first = last;
+  }
+}
+
+//// The key header and the decompressed object one after the other in
+/// record, the way TKey::ReadObj lays out its buffer.  record is where
+/// the key starts in the chunk.  False if the object didn't come out the
+/// size the key says.  Only touches the key and the buffers, so it can
+/// run in any thread
+bool ReadPlanner::unzip(TKey* key, const char* record, vector<char>& out) {
+  int keylen = key->GetKeylen(), objlen = key->GetObjlen();
+  int compressed = key->GetNbytes() - keylen;
+  out.resize(keylen + objlen);
+  memcpy(out.data(), record, keylen);
+  if(objlen <= compressed) {
+    memcpy(out.data() + keylen, record + keylen, objlen);
+    return true;
+  }
+
+  //// the object is compressed in blocks, each with its own header
+  unsigned char* source = (unsigned char*)record + keylen;
+  unsigned char* target = (unsigned char*)out.data() + keylen;
+  int total = 0;
+  while(total < objlen) {
+    int nin, nbuf, nout = 0;
+    if(R__unzip_header(&nin, source, &nbuf) != 0) break;
+    if(nin > compressed || nbuf > objlen - total) break;
+    R__unzip(&nin, source, &nbuf, target, &nout);
+    if(nout == 0) break;
+    total += nout;
+    compressed -= nin;
+    source += nin;
+    target += nout;
+  }
+  return total == objlen;
+}
+
+//// Makes the histogram from a record made by unzip, the same as the end
+/// of TKey::ReadObj.  Needs the file, so it is only done on the thread
+/// that holds it.  NULL if it can't be made
+TObject* ReadPlanner::stream(TKey* key, vector<char>& record) {
+  TClass* cl = TClass::GetClass(key->GetClassName());
+  if(!cl || !cl->InheritsFrom(TH1::Class())) return NULL;
+  TObject* object = (TObject*)cl->New();
+  if(!object) return NULL;
+
+  TBufferFile buffer(TBuffer::kRead, record.size(), record.data(), kFALSE);
+  buffer.SetParent(key->GetFile());
+  buffer.SetPidOffset(key->GetPidOffset());
+  buffer.SetBufferOffset(key->GetKeylen());
+  if(key->GetVersion() > 1) buffer.MapObject(object, cl);
+  object->Streamer(buffer);
+
+  auto addfunc = cl->GetDirectoryAutoAdd();
+  if(addfunc) addfunc(object, key->GetMotherDir());
+  return object;
+}
+
+//// ReadObj on its own, for keys that couldn't be done from a chunk
+TObject* ReadPlanner::readAlone(TKey* key) {
+  fallbacks++;
+  readCalls++;
+  bytesRead += key->GetNbytes();
+  return key->ReadObj();
+}
+
+string ReadPlanner::getStats() {
+  ostringstream stats;
+  long nkeys = keysRead.load(), ncalls = readCalls.load();
+  stats << "Read planner: " << nkeys << " keys in " << ncalls << " reads (" << nkeys - ncalls << " read calls saved), "
+	<< fixed << setprecision(1) << bytesRead.load()/1048576. << " MB read (" << gapBytes.load()/1048576. << " MB of gaps), "
+	<< "seeks over " << seekPlanned.load()/1048576. << " MB instead of " << seekGiven.load()/1048576. << " MB";
+  if(unzipped.load() > 0) stats << ", " << unzipped.load() << " unzipped by " << unzipWorkers << " workers";
+  if(fallbacks.load() > 0) stats << ", " << fallbacks.load() << " keys read with ReadObj";
+  return stats.str();
+}
+
+void ReadPlanner::resetStats() {
+  keysRead = 0;
+  readCalls = 0;
+  bytesRead = 0;
+  gapBytes = 0;
+  fallbacks = 0;
+  unzipped = 0;
+  seekGiven = 0;
+  seekPlanned = 0;
+}
@@ -0,0 +1,88 @@
+//////////////////////////////
+//// READPLANNER CLASS ///////
+//////////////////////////////
+
+/*
+
+Reads a lot of keys of one file with a few big reads instead of one
+ReadObj (and one seek) each.  The keys are sorted by where they are in
+the file (GetSeekKey), put together into chunks while the hole between
+one key and the next is small (maxGap) and the chunk isn't too big
+(maxChunk), and each chunk is read with one ReadBuffer.  The objects
+are then made from the buffer (ReadObjWithBuffer), nothing else is
+read for them.
+
+Going through a directory in key order (TIter nextkey) jumps back and
+forth over the file, which is very slow on spinning disks and network
+scratch.  Going by offset only ever reads forward.
+
+Objects are handed to take(k, object) in file order as each chunk is
+read (k is the place of the key in the list given), so only one chunk
+is in memory at a time.  NULL keys are skipped.  A chunk that can't be
+read, or a key that can't be made from the buffer, falls back to
+ReadObj.  Not thread safe per file: hold the lock of the file.
+
+With unzip workers (setUnzipWorkers, -unzip), the histograms of a chunk
+are decompressed (R__unzip) by that many threads at once, up to
+maxUnzip bytes of them at a time, and only streaming them into objects
+(TBufferFile, needs the streamer infos of the file) is done one after
+the other on the calling thread.  Anything that isn't a histogram goes
+to ReadObjWithBuffer like without workers.  Objects aren't added to a
+directory, same as ReadObj with TH1::AddDirectory(kFALSE).
+
+Counts keys, reads, bytes and how far the reads jumped (in the order
+given vs in file order), printed with getStats().
+
+ */
+
+#ifndef _READPLANNER_H_
+#define _READPLANNER_H_
+
+#include <TFile.h>
+#include <TKey.h>
+#include <TObject.h>
+#include <TClass.h>
+#include <TH1.h>
+#include <TBufferFile.h>
+#include <RZip.h>
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <stdlib.h>
+#include <string.h>
+#include "WorkerPool.h"
+
+using namespace std;
+
+class ReadPlanner {
+ public:
+  static void read(const vector<TKey*>&, function<void(int, TObject*)>);
+  static string getStats();
+  static void resetStats();
+  static void setUnzipWorkers(int n) {unzipWorkers = (n < 0) ? 0 : n;}
+
+  static const Long64_t maxGap = 64*1024;          //// hole read through instead of seeking over
+  static const Long64_t maxChunk = 32*1024*1024;   //// biggest single read
+  static const Long64_t maxUnzip = 64*1024*1024;   //// most decompressed at once (unzip workers)
+
+ private:
+  static void readChunk(const vector<TKey*>&, const vector<int>&, int, int, Long64_t, Long64_t,
+			vector<char>&, function<void(int, TObject*)>&);
+  static void unzipChunk(const vector<TKey*>&, const vector<int>&, int, int, Long64_t,
+			 vector<char>&, function<void(int, TObject*)>&);
+  static bool unzip(TKey*, const char*, vector<char>&);
+  static TObject* stream(TKey*, vector<char>&);
+  static TObject* readAlone(TKey*);
+  static Long64_t getEnd(TKey* key) {return key->GetSeekKey() + key->GetNbytes();}
+
+  static int unzipWorkers;   //// 0 is ReadObjWithBuffer on the calling thread
+  static atomic<long> keysRead, readCalls, bytesRead, gapBytes, fallbacks, unzipped;
+  static atomic<long long> seekGiven, seekPlanned;
+};
+
+#endif
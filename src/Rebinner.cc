@@ -0,0 +1,173 @@
+#include "Rebinner.h"
+
+using namespace std;
+
+const double EDGE_EPSILON = 0.0001;
+
+//// Explicit binning file (style/sample.binning).  Each line is a
+/// histogram title and [number, width] pairs, see fromSpec
+void Rebinner::readSpecs(string filename) {
+
+  ifstream info_file(filename);
+
+  if(!info_file) {
+    std::cout << "could not open file " << filename <<std::endl;
+    exit(1);
+  }
+
+  string line;
+  while(getline(info_file, line)) {
+    string name;
+    vector<string> tmpVals;
+    vector<pair<int, double>> tmpPairs;
+    string current = "";
+    int bracNum = 0;
+    for(auto it: line) {
+      if(it == '[' || it == ']' || it == ',') {
+	if(current != "") {
+	  if(bracNum == 0) name = current;
+	  else if(bracNum > 0) tmpVals.push_back(current);
+	  current = "";
+	}
+	if(it == '[' && ++bracNum > 2) {
+	  cout << "Error: Current code only allows for 2 levels of brackets.  Review line:" << endl;
+	  cout << line << endl;
+	  exit(1);
+	} else if(it == ']') {
+	  if(--bracNum < 0 || (tmpVals.size() != 2 && tmpVals.size() != 0)) {
+	    cout << "Error: Closing Bracket without corresponding open bracket: Review line:" << endl;
+	    cout << line << endl;
+	    exit(1);
+	  }
+	  if(tmpVals.size() == 2) tmpPairs.push_back(make_pair(stoi(tmpVals.at(0)), stod(tmpVals.at(1))));
+	  tmpVals.clear();
+	}
+      } else if(it == ' ' || it == '\t') continue;
+      else current.push_back(it);
+    }
+
+    if(bracNum != 0) {
+      cout << "Error: Not all Brackets were terminated.  Please review the line:" << endl;
+      cout << line << endl;
+      exit(1);
+    }
+    if(specs.find(name) != specs.end()) {
+      cout << "Duplicate histogram:" << endl;
+      cout << name << endl;
+      exit(1);
+    }
+    specs[name] = tmpPairs;
+  }
+  info_file.close();
+
+}
+
+//// Edges for the plot of hist.  Explicit specs are found by the title
+/// and win over the limit.  Empty if there is nothing to plot
+vector<double> Rebinner::getEdges(const TH1D* hist, double limit) const {
+  const TAxis* axis = hist->GetXaxis();
+  auto spec = specs.find(hist->GetTitle());
+  if(spec != specs.end()) return fromSpec(spec->second, axis->GetXmin(), axis->GetXmax());
+
+  vector<double> edges;
+  if(hist->GetEntries() == 0 || hist->Integral() <= 0) return edges;
+
+  int nbins = axis->GetNbins();
+  const double* sumw = hist->GetArray();
+  vector<double> errors;
+  const double* sumw2 = NULL;
+  if(hist->GetSumw2N() > 0) sumw2 = hist->GetSumw2()->GetArray();
+  else {
+    for(int i = 0; i < nbins + 2; i++) errors.push_back(abs(sumw[i]));
+    sumw2 = errors.data();
+  }
+
+  return fromLimit(sumw, sumw2, axis, limit);
+}
+
+//// Groups bins from the right until sqrt(2*sumw2)/sumw of the group is
+/// under limit, using prefix sums of the positive bins (empty and
+/// negative bins are skipped, their range goes to the group they're in).
+///   - the last edge is the top of the last positive bin
+///   - what's left at the end that never got under the limit is one
+///     more bin down to the first positive bin
+///   - axes starting at 0 or more go all the way down to the start
+/// Edges are returned going up
+vector<double> Rebinner::fromLimit(const double* sumw, const double* sumw2, const TAxis* axis, double limit) {
+  vector<double> edges;
+  int nbins = axis->GetNbins();
+
+  //// psum[i] is the sum of the positive bins 1 to i
+  vector<double> psum(nbins + 1, 0.0), psum2(nbins + 1, 0.0);
+  int first = 0, last = 0;
+  for(int i = 1; i <= nbins; i++) {
+    bool positive = sumw[i] > 0.0;
+    psum[i] = psum[i-1] + ((positive) ? sumw[i] : 0.0);
+    psum2[i] = psum2[i-1] + ((positive) ? sumw2[i] : 0.0);
+    if(!positive) continue;
+    if(first == 0) first = i;
+    last = i;
+  }
+  if(last == 0) return edges;
+
+  double limit2 = limit*limit;
+  edges.push_back(axis->GetBinUpEdge(last));
+  int top = last;
+  for(int i = last; i >= first; i--) {
+    if(sumw[i] <= 0.0) continue;
+    double w = psum[top] - psum[i-1], w2 = psum2[top] - psum2[i-1];
+    if(2*w2 < limit2*w*w) {
+      edges.push_back(axis->GetBinLowEdge(i));
+      top = i - 1;
+    }
+  }
+
+  double low = axis->GetBinLowEdge(first);
+  if(edges.back() > low) edges.push_back(low);
+  if(axis->GetXmin() >= 0 && edges.back() > axis->GetXmin()) edges.push_back(axis->GetXmin());
+
+  reverse(edges.begin(), edges.end());
+  return edges;
+}
+
+//// Edges from [number, width] pairs, starting at xmin:
+///   [N, W]  N bins of width W
+///   [-1, W] bins of width W as far as they fit
+///   [N, -1] N bins of the same width to the end
+/// The last bin is stretched (or cut) to end at xmax
+vector<double> Rebinner::fromSpec(const vector<pair<int, double>>& spec, double xmin, double xmax) {
+  vector<double> edges(1, xmin);
+  double currentVal = xmin;
+
+  for(auto it: spec) {
+    int numLeft = it.first;
+    double binWidth = it.second;
+    if(binWidth <= 0) {
+      if(numLeft <= 0) {
+	numLeft = 1;
+      }
+      binWidth = (xmax - currentVal)/numLeft;
+    } else if(numLeft <= 0) {
+      numLeft = (int)((xmax - currentVal)/binWidth);
+    }
+    while(numLeft > 0 && currentVal + binWidth < xmax - EDGE_EPSILON) {
+      currentVal += binWidth;
+      edges.push_back(currentVal);
+      numLeft--;
+    }
+  }
+  edges.push_back(xmax);
+
+  return edges;
+}
+
+//// The bins hist already has (RebinFactor plots).  Empty if there is
+/// nothing to plot, same as getEdges
+vector<double> Rebinner::fromAxis(const TH1D* hist) {
+  vector<double> edges;
+  if(hist->GetEntries() == 0 || hist->Integral() <= 0) return edges;
+  const TAxis* axis = hist->GetXaxis();
+  for(int i = 1; i <= axis->GetNbins(); i++) edges.push_back(axis->GetBinLowEdge(i));
+  edges.push_back(axis->GetXmax());
+  return edges;
+}
@@ -0,0 +1,57 @@
+//////////////////////////////
+//// REBINNER CLASS //////////
+//////////////////////////////
+
+/*
+
+Picks the bin edges each plot gets rebinned to.  Two ways:
+
+  - explicit specs from style/sample.binning, found by the title of
+    the histogram (same format as before, [number, width] pairs)
+  - from the errors (RebinLimit in the style file): going from the
+    right, bins are put together until sqrt(2*sumw2)/sumw of the
+    group is under the limit.  Bins with nothing in them don't count
+    and get folded in with their neighbours.
+
+The error version works on prefix sums of sumw and sumw2 of the
+positive bins, so each group is just a difference of two sums.  Both
+always give edges going up (at least 2 of them) or nothing at all.
+
+That is one pass over the bins, so the edges are just worked out again
+each time instead of being cached.  Can be used from the plot workers
+at once (only readSpecs changes anything).
+
+ */
+
+#ifndef _REBINNER_H_
+#define _REBINNER_H_
+
+#include <TH1.h>
+#include <TAxis.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+class Rebinner {
+ public:
+  void readSpecs(string);
+  bool hasSpec(const string& title) const {return specs.find(title) != specs.end();}
+  vector<double> getEdges(const TH1D*, double) const;
+
+  static vector<double> fromLimit(const double*, const double*, const TAxis*, double);
+  static vector<double> fromSpec(const vector<pair<int, double>>&, double, double);
+  static vector<double> fromAxis(const TH1D*);
+
+ private:
+  unordered_map<string, vector<pair<int, double>>> specs;
+};
+
+#endif
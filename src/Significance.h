@@ -0,0 +1,143 @@
+//////////////////////////////
+//// SIGNIFICANCE KERNELS ////
+//////////////////////////////
+
+/*
+
+Significance plot on the bottom of the canvas (SigLeft, SigRight and
+SigBin), done on the bin arrays of the signal and background
+histograms (contents and sumw2, nbins+2 entries like in
+HistKernels.h).
+
+The old loop called IntegralAndError for every bin, so SigLeft and
+SigRight went over the histogram once per bin.  Here the running sums
+of the contents and sumw2 are kept as the loop goes (SigLeft) or made
+once from the right (SigRight), so it's one pass either way.
+
+The formula and the edge are template arguments, so each of the
+combinations is its own loop with nothing to decide per bin.
+
+  SOverSqrtSB   S/sqrt(S+B)                  (default)
+  SOverSqrtB    S/sqrt(B)                    (-ssqrtb)
+  AsimovZ       sqrt(2((S+B)ln(1+S/B) - S))  (-asimov)
+
+Same numbers as the old loop: SigLeft and SigBin give the same bits
+(SigLeft also sums the bins on its left after they've been turned into
+significances, like IntegralAndError on the half filled clone did),
+SigRight only differs in the last bits since the sums go the other way.
+
+Nothing in here knows about ROOT (see bench/).
+
+ */
+
+#ifndef _SIGNIFICANCE_H_
+#define _SIGNIFICANCE_H_
+
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+enum SigFormula {SOverSqrtSB, SOverSqrtB, AsimovZ};
+enum SigEdge {EdgeBin, EdgeLeft, EdgeRight};
+
+//// Each formula gives the value and error from the integrals of the
+/// signal (s, serr) and background (b, berr).  The first two keep the
+/// old error (value times the summed squared relative errors)
+struct SOverSqrtSBFormula {
+  static inline void apply(double s, double serr, double b, double berr, double& value, double& error) {
+    value = s/sqrt(s+b);
+    double perErr = pow(serr/s-serr/(2*(s+b)),2) + pow(berr/(2*(s+b)),2);
+    error = value*perErr;
+  }
+};
+
+struct SOverSqrtBFormula {
+  static inline void apply(double s, double serr, double b, double berr, double& value, double& error) {
+    value = s/sqrt(b);
+    double perErr = pow(serr/s,2) + pow(berr/(2*b),2);
+    error = value*perErr;
+  }
+};
+
+//// Asimov discovery significance Z0, error propagated from s and b.
+/// Not defined without background, gives 0 there
+struct AsimovZFormula {
+  static inline void apply(double s, double serr, double b, double berr, double& value, double& error) {
+    if(b <= 0 || s + b <= 0) {
+      value = error = 0;
+      return;
+    }
+    double logterm = log(1 + s/b);
+    double z2 = 2*((s+b)*logterm - s);
+    value = (z2 > 0) ? sqrt(z2) : 0;
+    if(value == 0) {
+      error = 0;
+      return;
+    }
+    double dzds = logterm/value, dzdb = (logterm - s/b)/value;
+    error = sqrt(pow(dzds*serr,2) + pow(dzdb*berr,2));
+  }
+};
+
+//// sig/sigw2 are overwritten with the significance and its error
+/// squared for bins 1 to nbins.  Bins where both signal and background
+/// are <= 0 are left alone
+template <typename Formula, SigEdge Edge>
+void significanceKernel(double* sig, double* sigw2, const double* back, const double* backw2, int nbins) {
+  double value, error;
+  if(Edge == EdgeBin) {
+    for(int i = 1; i <= nbins; i++) {
+      if(sig[i] <= 0 && back[i] <= 0) continue;
+      Formula::apply(sig[i], sqrt(sigw2[i]), back[i], sqrt(backw2[i]), value, error);
+      sig[i] = value;
+      sigw2[i] = error*error;
+    }
+  } else if(Edge == EdgeLeft) {
+    //// sums of bins 0 to i-1, as they are when bin i is done
+    double ssum = sig[0], sw2sum = sigw2[0], bsum = back[0], bw2sum = backw2[0];
+    for(int i = 1; i <= nbins; i++) {
+      double s = ssum + sig[i], sw2 = sw2sum + sigw2[i];
+      bsum += back[i];
+      bw2sum += backw2[i];
+      if(!(sig[i] <= 0 && back[i] <= 0)) {
+	Formula::apply(s, sqrt(sw2), bsum, sqrt(bw2sum), value, error);
+	sig[i] = value;
+	sigw2[i] = error*error;
+      }
+      ssum += sig[i];
+      sw2sum += sigw2[i];
+    }
+  } else {
+    //// sums of bins i to nbins, made from the right before anything changes
+    vector<double> ssum(nbins+2, 0), sw2sum(nbins+2, 0), bsum(nbins+2, 0), bw2sum(nbins+2, 0);
+    for(int i = nbins; i >= 1; i--) {
+      ssum[i] = ssum[i+1] + sig[i];
+      sw2sum[i] = sw2sum[i+1] + sigw2[i];
+      bsum[i] = bsum[i+1] + back[i];
+      bw2sum[i] = bw2sum[i+1] + backw2[i];
+    }
+    for(int i = 1; i <= nbins; i++) {
+      if(sig[i] <= 0 && back[i] <= 0) continue;
+      Formula::apply(ssum[i], sqrt(sw2sum[i]), bsum[i], sqrt(bw2sum[i]), value, error);
+      sig[i] = value;
+      sigw2[i] = error*error;
+    }
+  }
+}
+
+template <typename Formula>
+void significanceKernel(SigEdge edge, double* sig, double* sigw2, const double* back, const double* backw2, int nbins) {
+  if(edge == EdgeLeft) significanceKernel<Formula, EdgeLeft>(sig, sigw2, back, backw2, nbins);
+  else if(edge == EdgeRight) significanceKernel<Formula, EdgeRight>(sig, sigw2, back, backw2, nbins);
+  else significanceKernel<Formula, EdgeBin>(sig, sigw2, back, backw2, nbins);
+}
+
+//// Picks the loop once per histogram
+inline void computeSignificance(SigFormula formula, SigEdge edge, double* sig, double* sigw2, const double* back, const double* backw2, int nbins) {
+  if(formula == AsimovZ) significanceKernel<AsimovZFormula>(edge, sig, sigw2, back, backw2, nbins);
+  else if(formula == SOverSqrtB) significanceKernel<SOverSqrtBFormula>(edge, sig, sigw2, back, backw2, nbins);
+  else significanceKernel<SOverSqrtSBFormula>(edge, sig, sigw2, back, backw2, nbins);
+}
+
+#endif
@@ -207,6 +207,7 @@ void Style::setStyle() {
     else if(it->first == "DoOverflow") dooverflow = it->second;
     else if(it->first == "DivideBins") dividebins = ((int)it->second != 0);
     else if(it->first == "BinLimit") binlimit = it->second;
+    else if(it->first == "RebinFactor") rebinfactor = it->second;
   }
 
   gStyle = styler;
@@ -71,12 +71,13 @@ class Style {
   bool getDivideBins() {return dividebins;}
   bool getBinLimit() {return binlimit;}
   bool getDoOverflow() {return dooverflow;}
+  int getRebinFactor() {return rebinfactor;}
  
  private:
   TStyle* styler;
   map<string, double> values;
   //  map<string,string> axisLabel = { {} }
-  int binlimit = 9;
+  int binlimit = 9, rebinfactor = 1;
   double padratio = 3, heightratio = 15, rebinlimit = 0.3, dooverflow= 0;
   bool dividebins = false;
 };
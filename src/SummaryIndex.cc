@@ -0,0 +1,70 @@
+#include "SummaryIndex.h"
+
+using namespace std;
+
+//// Numbers of one histogram.  Integral, sumw2 and the maximum are over
+/// bins 1 to nbins (same as Integral() and GetMaximum())
+HistSummary SummaryIndex::summarize(const TH1* hist) {
+  HistSummary summary;
+  summary.integral = hist->Integral();
+  summary.max = hist->GetMaximum();
+  summary.entries = hist->GetEntries();
+  summary.empty = summary.entries == 0 || summary.integral <= 0;
+  summary.title = hist->GetTitle();
+  for(int i = 1; i <= hist->GetXaxis()->GetNbins(); i++) summary.sumw2 += pow(hist->GetBinError(i), 2);
+  return summary;
+}
+
+//// Can be called from more than one thread
+void SummaryIndex::add(const string& path, const string& name, const TH1* hist) {
+  HistSummary summary = summarize(hist);
+  lock_guard<mutex> lock(addLock);
+  entries[getKey(path, name)] = summary;
+}
+
+//// NULL if the histogram isn't in the summary
+const HistSummary* SummaryIndex::find(const string& path, const string& name) const {
+  auto found = entries.find(getKey(path, name));
+  return (found == entries.end()) ? NULL : &found->second;
+}
+
+//// False (and nothing read) if there is no file or it was made for
+/// another file than the one with this uuid
+bool SummaryIndex::read(const string& filename, const string& uuid) {
+  ifstream summaryfile(filename);
+  string line, type, fileuuid;
+  if(!getline(summaryfile, line)) return false;
+  istringstream header(line);
+  header >> type >> fileuuid;
+  if(type != "summary" || fileuuid != uuid) return false;
+
+  while(getline(summaryfile, line)) {
+    istringstream tokens(line);
+    string path, name, numbers, title;
+    if(!getline(tokens, path, '\t') || !getline(tokens, name, '\t') || !getline(tokens, numbers, '\t')) continue;
+    getline(tokens, title);
+
+    HistSummary& summary = entries[getKey(path, name)];
+    istringstream numberstream(numbers);
+    numberstream >> summary.integral >> summary.sumw2 >> summary.max >> summary.entries >> summary.empty;
+    summary.title = title;
+  }
+  summaryfile.close();
+  return true;
+}
+
+//// Writes to a temporary file and moves it over the old one, so a
+/// reader never sees half a summary
+void SummaryIndex::write(const string& filename, const string& uuid) {
+  string tmpname = filename + ".tmp" + to_string(getpid());
+  ofstream summaryfile(tmpname);
+  summaryfile << "summary " << uuid << endl;
+  summaryfile << setprecision(17);
+  for(auto& entry: entries) {
+    const HistSummary& summary = entry.second;
+    summaryfile << entry.first << "\t" << summary.integral << " " << summary.sumw2 << " " << summary.max
+		<< " " << summary.entries << " " << summary.empty << "\t" << summary.title << endl;
+  }
+  summaryfile.close();
+  rename(tmpname.c_str(), filename.c_str());
+}
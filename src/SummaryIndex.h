@@ -0,0 +1,64 @@
+//////////////////////////////
+//// SUMMARYINDEX CLASS //////
+//////////////////////////////
+
+/*
+
+A few numbers for every histogram of a normalized file (integral,
+total sumw2, maximum, entries, empty or not and the title), written
+next to it as <name>.summary when the file is normalized.  The plotter
+uses them to skip empty plots and to order the stack without reading
+(or even looking at the bins of) the histograms.
+
+Text file, first line has the UUID of the normalized file so a summary
+that doesn't belong to it (file remade without it) is never used:
+
+  summary <uuid>
+  <path> \t <name> \t <integral> <sumw2> <max> <entries> <empty> \t <title>
+
+Pyramid levels (-pyramid) are in it like any other histogram.
+
+ */
+
+#ifndef _SUMMARYINDEX_H_
+#define _SUMMARYINDEX_H_
+
+#include <TH1.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <mutex>
+#include <cmath>
+
+using namespace std;
+
+struct HistSummary {
+  double integral = 0, sumw2 = 0, max = 0, entries = 0;
+  bool empty = true;   //// no entries or integral <= 0, nothing to plot
+  string title;
+};
+
+class SummaryIndex {
+ public:
+  void add(const string&, const string&, const TH1*);
+  const HistSummary* find(const string&, const string&) const;
+  int size() const {return entries.size();}
+
+  bool read(const string&, const string&);
+  void write(const string&, const string&);
+
+  static HistSummary summarize(const TH1*);
+
+ private:
+  unordered_map<string, HistSummary> entries;
+  mutex addLock;
+
+  static string getKey(const string& path, const string& name) {return path + "\t" + name;}
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "WorkerPool.h"
+
+using namespace std;
+
+WorkerPool::WorkerPool(int nworkers) {
+  this->nworkers = (nworkers < 1) ? 1 : nworkers;
+}
+
+//// Runs job(0) ... job(njobs-1).  Jobs are dealt out round robin to one
+/// queue per worker (worker w gets w, w+n, w+2n, ...).  Each worker works
+/// through the front of its own queue, and when that is empty steals from
+/// the front of the fullest other queue, so a worker stuck on a long job
+/// doesn't hold up the rest of its queue.  Jobs still start roughly in
+/// order.  Returns when all jobs are done
+void WorkerPool::run(int njobs, function<void(int)> job) {
+  if(nworkers == 1 || njobs <= 1) {
+    for(int i = 0; i < njobs; i++) job(i);
+    return;
+  }
+
+  int nthreads = (njobs < nworkers) ? njobs : nworkers;
+  vector<deque<int>> queues(nthreads);
+  vector<mutex> locks(nthreads);
+  for(int i = 0; i < njobs; i++) queues.at(i % nthreads).push_back(i);
+
+  //// next job for worker w, -1 when there is nothing left anywhere
+  auto nextJob = [&](int w) {
+    for(int tries = 0; ; tries++) {
+      int victim = w;
+      if(tries > 0) {
+	size_t most = 0;
+	victim = -1;
+	for(int v = 0; v < nthreads; v++) {
+	  lock_guard<mutex> guard(locks.at(v));
+	  if(queues.at(v).size() > most) {
+	    most = queues.at(v).size();
+	    victim = v;
+	  }
+	}
+	if(victim < 0) return -1;
+      }
+      lock_guard<mutex> guard(locks.at(victim));
+      if(!queues.at(victim).empty()) {
+	int current = queues.at(victim).front();
+	queues.at(victim).pop_front();
+	return current;
+      }
+    }
+  };
+
+  vector<thread> workers;
+  for(int w = 0; w < nthreads; w++) {
+    workers.push_back(thread([&, w]() {
+	  int current;
+	  while((current = nextJob(w)) >= 0) job(current);
+	}));
+  }
+  for(auto& worker: workers) worker.join();
+}
+
+//// Runs job(i) in the workers and write(i) on the calling thread for
+/// i = 0 ... njobs-1.  write(i) is called in order, after job(i) is done.
+/// Job i doesn't start until write(i - 4*nworkers) is done
+void WorkerPool::runOrdered(int njobs, function<void(int)> job, function<void(int)> write) {
+  if(nworkers == 1 || njobs <= 1) {
+    for(int i = 0; i < njobs; i++) {
+      job(i);
+      write(i);
+    }
+    return;
+  }
+
+  int window = 4*nworkers, written = 0;
+  vector<char> done(njobs, 0);
+  mutex lock;
+  condition_variable changed;
+
+  thread runner([&]() {
+      run(njobs, [&](int i) {
+	  {
+	    unique_lock<mutex> guard(lock);
+	    changed.wait(guard, [&]() {return i < written + window;});
+	  }
+	  job(i);
+	  {
+	    lock_guard<mutex> guard(lock);
+	    done.at(i) = 1;
+	  }
+	  changed.notify_all();
+	});
+    });
+
+  for(int i = 0; i < njobs; i++) {
+    {
+      unique_lock<mutex> guard(lock);
+      changed.wait(guard, [&]() {return done.at(i) != 0;});
+    }
+    write(i);
+    {
+      lock_guard<mutex> guard(lock);
+      written = i + 1;
+    }
+    changed.notify_all();
+  }
+  runner.join();
+}
@@ -0,0 +1,50 @@
+////////////////////////////
+//// WORKERPOOL CLASS //////
+////////////////////////////
+
+/*
+
+Small pool of std::threads used to spread independent jobs
+(eg normalizing each output group) over the cores of the machine.
+
+Jobs are numbered 0 to N-1 and dealt out in that order to one queue
+per worker, so the caller decides the schedule by ordering the jobs
+(largest first is usually what you want).  Workers that run out of
+jobs steal from the others (work stealing), so one slow job doesn't
+leave the jobs queued behind it waiting.  With one worker everything
+runs on the calling thread, so the old sequential behaviour is kept.
+
+runOrdered is for jobs whose results have to be used in order (ie
+written to a file): the jobs run in the workers while the calling
+thread takes the results one after the other, as soon as each one is
+ready.  Workers only get a few jobs ahead of the writer so finished
+results don't pile up in memory.
+
+ */
+
+#ifndef _WORKERPOOL_H_
+#define _WORKERPOOL_H_
+
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+class WorkerPool {
+ public:
+  WorkerPool(int nworkers=1);
+
+  int getWorkers() {return nworkers;}
+  void run(int, function<void(int)>);
+  void runOrdered(int, function<void(int)>, function<void(int)>);
+
+ private:
+  int nworkers;
+};
+
+#endif
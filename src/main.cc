@@ -1,7 +1,10 @@
 #include "Plotter.h"
+#include <TMemFile.h>
 #include "Normalizer.h"
 #include "Logfile.h"
 #include "Style.h"
+#include "NormCache.h"
+#include "Compression.h"
 #include "tokenizer.hpp"
 
 
@@ -10,12 +13,15 @@ using namespace std;
 ///// Read in config file that is used to find the files to normalize 
 /// and then put in the Plotter
 void read_info(string, map<string, Normer*>&);
-int getModTime(const char *path);
-bool process_dummy(string inConfig);
 
 ////Default output and style config file names.  Don't like that they are global, but works
 string output = "output.root";
 string stylename = "default";
+//// treemerge lines in the config: group -> how its trees are merged
+map<string, string> treeModes;
+//// compression lines in the config for the normalized files (and their
+/// sidecars) and for the output file.  Empty is ROOT's default
+string normCompression = "", outputCompression = "";
 
 int main(int argc, char* argv[]) {
   if(argc < 2) {
@@ -27,7 +33,13 @@ int main(int argc, char* argv[]) {
 
   map<string, Normer*> plots;
   Plotter fullPlot;
-  bool needToRenorm = false;
+  bool needToRenorm = false, deferScale = false, useKernel = true, pyramid = false;
+  int nworkers = 1, inputWorkers = 0, dirWorkers = 1, plotProcs = 1, imtThreads = -1, unzipWorkers = 0;
+  int shard = -1, nshards = 0;
+  bool mergeShards = false, normOnly = false;
+  string spoolDir = "";
+  PathFilter filter;
+  string normCompressionArg = "", outputCompressionArg = "";
 
   ///// Parse input variables to change options and read in config files
   for(int i = 1; i < argc; ++i) {
@@ -49,21 +61,106 @@ int main(int argc, char* argv[]) {
         cout << "                  s/sqrt(s + b)" << endl;
 	cout << "                  This option changes the significance calculation to be:" << endl;
 	cout << "                  s/sqrt(b)" << endl;
+	cout << "    -asimov       Use the Asimov significance for the significance plots:" << endl;
+	cout << "                  sqrt(2((s + b)ln(1 + s/b) - s))" << endl;
 	cout << "    -onlytop      Don't make bottom plot (either significance or ratio plots" << endl;
         cout << "                  Will only print top if no data is given (nothing to compare to" << endl;
+	cout << "    -renorm       Normalize all of the groups again, even the ones that" << endl;
+	cout << "                  haven't changed since the last run" << endl;
+	cout << "    -deferscale   Also save the unscaled histograms of each input file next" << endl;
+	cout << "                  to the normalized file (<group>.parts.root).  If only the" << endl;
+	cout << "                  xsec, skim, SF or lumi change, the group is rescaled from" << endl;
+	cout << "                  it without reading the input files again" << endl;
+	cout << "    -pyramid      Also write every histogram rebinned by 2, 4 and 8 into" << endl;
+	cout << "                  __pyramid/ in the normalized files.  Plots with RebinFactor" << endl;
+	cout << "                  2, 4 or 8 in the style file read those instead of rebinning" << endl;
+	cout << "    -oldmerge     Fix errors, scale and add the histograms in separate passes" << endl;
+	cout << "                  with TH1 calls instead of the fused kernel (for checking)" << endl;
+	cout << "    -j N          Normalize the groups using N threads (default 1).  Biggest" << endl;
+	cout << "                  groups are started first.  The plots are also made with" << endl;
+	cout << "                  N threads (written in the same order as with one)" << endl;
+	cout << "    -jin N        Read and scale the input files of each group using N" << endl;
+	cout << "                  threads, then add them up in a fixed pairwise order.  Result" << endl;
+	cout << "                  is the same for any N, but can differ in the last digits" << endl;
+	cout << "                  from the default one by one adding" << endl;
+	cout << "    -jdir N       Merge the directories of each group using N threads.  The" << endl;
+	cout << "                  directories are still written in the same order" << endl;
+	cout << "    -procs N      Make the plots in N forked processes instead of threads" << endl;
+	cout << "                  (ROOT drawing isn't thread safe).  Each one writes its own" << endl;
+	cout << "                  <output>.shardN file, which are copied into the output in" << endl;
+	cout << "                  order at the end.  Wins over -j for the plots" << endl;
+	cout << "    -normonly     Only normalize the groups (and update the cache), no plots" << endl;
+	cout << "    -shard i/N    Only make part i (0 to N-1) of the plots, into" << endl;
+	cout << "                  <output>.shard<i> and <output>.shard<i>.cutflow.  Meant for" << endl;
+	cout << "                  batch jobs, run with -normonly once before the shards" << endl;
+	cout << "    -merge-shards Put all of the shards together into the output file and" << endl;
+	cout << "                  logfile, same as one run would make them" << endl;
+	cout << "    -spool DIR    Make the plots as a spool worker: take batches of plots" << endl;
+	cout << "                  from DIR (lock files, so any number of workers on any" << endl;
+	cout << "                  number of hosts sharing DIR) until none are left.  With" << endl;
+	cout << "                  -merge-shards, put the finished batches into the output." << endl;
+	cout << "                  Run with -normonly once before the workers" << endl;
+	cout << "    -only PATTERN Only merge and plot the histograms whose dir/histogram path" << endl;
+	cout << "                  matches PATTERN (a glob, or a regex if it starts with re:)." << endl;
+	cout << "                  Can be given more than once" << endl;
+	cout << "    -exclude PATTERN  Leave out the histograms matching PATTERN (same kind of" << endl;
+	cout << "                  pattern, more than one is fine).  Wins over -only" << endl;
+	cout << "    -store TYPE   Keep all of the normalized histograms in memory as float" << endl;
+	cout << "                  or double arrays (TYPE) instead of reading them back from" << endl;
+	cout << "                  the normalized files when plotting" << endl;
+	cout << "    -normcomp ALG[:LEVEL]  Compression of the normalized files (and sidecars)." << endl;
+	cout << "                  ALG is zlib, lzma, lz4 or zstd.  Same as the config line" << endl;
+	cout << "                  compression normed ALG [LEVEL], but wins over it" << endl;
+	cout << "    -outcomp ALG[:LEVEL]   Same for the output file (config: compression output)" << endl;
+	cout << "    -imt N        Let ROOT compress tree baskets with N threads (0 is all" << endl;
+	cout << "                  cores).  Only helps when trees are copied" << endl;
+	cout << "    -unzip N      Decompress the histograms read from each file with N" << endl;
+	cout << "                  threads, only making the objects is done one at a time." << endl;
+	cout << "                  Default 0 makes them one at a time like ReadObj" << endl;
 
 	exit(0);
       } else if( strcmp(argv[i], "-sigleft") == 0) fullPlot.setBottomType(SigLeft);
       else if( strcmp(argv[i], "-sigright") == 0) fullPlot.setBottomType(SigRight);
       else if( strcmp(argv[i],"-sigbin") == 0) fullPlot.setBottomType(SigBin);
       else if( strcmp(argv[i],"-ssqrtb") == 0) fullPlot.setSignificanceSSqrtB();
+      else if( strcmp(argv[i],"-asimov") == 0) fullPlot.setSignificanceAsimov();
       else if( strcmp(argv[i],"-onlytop") == 0) fullPlot.setNoBottom();
+      else if( strcmp(argv[i],"-renorm") == 0) needToRenorm = true;
+      else if( strcmp(argv[i],"-deferscale") == 0) deferScale = true;
+      else if( strcmp(argv[i],"-pyramid") == 0) pyramid = true;
+      else if( strcmp(argv[i],"-oldmerge") == 0) useKernel = false;
+      else if( strcmp(argv[i],"-j") == 0 && i+1 < argc) nworkers = atoi(argv[++i]);
+      else if( strcmp(argv[i],"-jin") == 0 && i+1 < argc) inputWorkers = max(1, atoi(argv[++i]));
+      else if( strcmp(argv[i],"-jdir") == 0 && i+1 < argc) dirWorkers = max(1, atoi(argv[++i]));
+      else if( strcmp(argv[i],"-procs") == 0 && i+1 < argc) plotProcs = max(1, atoi(argv[++i]));
+      else if( strcmp(argv[i],"-shard") == 0 && i+1 < argc) {
+	if(sscanf(argv[++i], "%d/%d", &shard, &nshards) != 2 || nshards < 1 || shard < 0 || shard >= nshards) {
+	  cout << "-shard needs i/N with 0 <= i < N, exiting" << endl;
+	  exit(0);
+	}
+      }
+      else if( strcmp(argv[i],"-merge-shards") == 0) mergeShards = true;
+      else if( strcmp(argv[i],"-normonly") == 0) normOnly = true;
+      else if( strcmp(argv[i],"-spool") == 0 && i+1 < argc) spoolDir = argv[++i];
+      else if( strcmp(argv[i],"-only") == 0 && i+1 < argc) filter.addOnly(argv[++i]);
+      else if( strcmp(argv[i],"-exclude") == 0 && i+1 < argc) filter.addExclude(argv[++i]);
+      else if( strcmp(argv[i],"-normcomp") == 0 && i+1 < argc) normCompressionArg = argv[++i];
+      else if( strcmp(argv[i],"-outcomp") == 0 && i+1 < argc) outputCompressionArg = argv[++i];
+      else if( strcmp(argv[i],"-imt") == 0 && i+1 < argc) imtThreads = max(0, atoi(argv[++i]));
+      else if( strcmp(argv[i],"-unzip") == 0 && i+1 < argc) unzipWorkers = max(0, atoi(argv[++i]));
+      else if( strcmp(argv[i],"-store") == 0 && i+1 < argc) {
+	string type = argv[++i];
+	if(type != "float" && type != "double") {
+	  cout << "-store needs float or double, exiting" << endl;
+	  exit(0);
+	}
+	fullPlot.setStore(type);
+      }
       else {
 	cout << "wrong option, exiting" << endl;
 	exit(0);
       }
     } else {
-      needToRenorm =  process_dummy(argv[i]);
       read_info(argv[i], plots);
     }
   }
@@ -71,17 +168,83 @@ int main(int argc, char* argv[]) {
 
 
   fullPlot.getPresetBinning("style/sample.binning");
+  fullPlot.readLabelRules("style/labels");
+
+  //// command line wins over the config
+  if(normCompressionArg != "") normCompression = normCompressionArg;
+  if(outputCompressionArg != "") outputCompression = outputCompressionArg;
+  int normComp = (normCompression == "") ? -1 : parseCompression(normCompression);
+  int outputComp = (outputCompression == "") ? -1 : parseCompression(outputCompression);
+  if(normComp == -2 || outputComp == -2) {
+    cout << "compression needs zlib, lzma, lz4 or zstd (with an optional :LEVEL of 0-9), exiting" << endl;
+    exit(0);
+  }
+  if(imtThreads >= 0) ROOT::EnableImplicitMT(imtThreads);
+  ReadPlanner::setUnzipWorkers(unzipWorkers);
 
+  for(auto& mode: treeModes) {
+    if(plots.find(mode.first) == plots.end()) cout << "treemerge: no group called " << mode.first << ", ignoring it" << endl;
+  }
+
+  //// Only groups whose inputs or numbers changed get normalized again
+  NormCache cache;
   int totalfiles = 0;
+  vector<Normer*> groups;
   for(map<string, Normer*>::iterator it = plots.begin(); it != plots.end(); ++it) {
-    if(needToRenorm) it->second->setUse();
-    fullPlot.addFile(*it->second);
+    Normer* norm = it->second;
+    norm->deferScale = deferScale;
+    norm->pyramid = pyramid;
+    norm->inputWorkers = inputWorkers;
+    norm->dirWorkers = dirWorkers;
+    norm->useKernel = useKernel;
+    norm->compression = normComp;
+    norm->filter = &filter;
+    if(treeModes.count(it->first)) norm->treeMode = treeModes[it->first];
+    if(norm->use == 1 && !needToRenorm) {
+      if(cache.isCurrent(*norm)) norm->use = 2;
+      else if(cache.canRescale(*norm)) norm->rescale = true;
+    }
+    groups.push_back(norm);
   }
 
-  cout << "Finished Normalization" << endl;
+  //// shards and the merge run on many nodes at once, so they can't be
+  /// writing the same normalized files.  That's done once with -normonly
+  if(shard >= 0 || mergeShards || spoolDir != "") {
+    for(auto norm: groups) {
+      if(norm->use != 1) continue;
+      cout << norm->getFilename() << " needs to be normalized, run with -normonly first, exiting" << endl;
+      exit(1);
+    }
+  }
+
+  fullPlot.setFilter(&filter);
+  fullPlot.addFiles(groups, nworkers);
+  fullPlot.setPlotWorkers(nworkers);
+  fullPlot.setPlotProcs(plotProcs);
+  if(shard >= 0) fullPlot.setShard(shard, nshards);
+  if(mergeShards) fullPlot.setMergeShards();
+  if(spoolDir != "") fullPlot.setSpool(spoolDir);
 
-  TFile* final = new TFile(output.c_str(), "RECREATE");
-  Logfile logfile;
+  for(auto norm: groups) {
+    if(norm->use == 1) cache.update(*norm);
+  }
+  //// new file hashes are kept even if nothing was remade, so a touched
+  /// input isn't hashed again next time.  Shards, spool workers and the
+  /// merge run on many nodes at once and leave the cache alone
+  if(cache.hasChanges() && shard < 0 && !mergeShards && spoolDir == "") cache.save();
+
+  cout << "Finished Normalization" << endl;
+  if(normOnly) return 0;
+
+  //// a shard writes only its own file.  Its cutflow lines go to the
+  /// shard's .cutflow file, not the logfile.  A spool worker writes
+  /// everything into the spool, its output file is only kept in memory
+  /// for the directories
+  bool spoolWorker = (spoolDir != "" && !mergeShards);
+  string finalname = (shard >= 0) ? Plotter::getShardName(output, shard) : output;
+  TFile* final = (spoolWorker) ? new TMemFile("spool", "RECREATE") : new TFile(finalname.c_str(), "RECREATE");
+  if(outputComp >= 0) final->SetCompressionSettings(outputComp);
+  Logfile logfile((shard >= 0 || spoolWorker) ? "/dev/null" : "log.txt");
   logfile.setHeader(fullPlot.getFilenames("all"));
 
   Style stylez("style/" + stylename);
@@ -121,7 +284,23 @@ void read_info(string filename, map<string, Normer*>& plots) {
     }
 
     if(stemp.size() >= 2) {
-      if(stemp[0].find("lumi") != string::npos) lumi = stod(stemp[1]);
+      if(stemp[0] == "treemerge") {
+	if(stemp.size() < 3 || (stemp[2] != "copy" && stemp[2] != "fast" && stemp[2] != "virtual" && stemp[2] != "skip")) {
+	  cout << "treemerge needs a group and copy, fast, virtual or skip: " << line << endl;
+	  exit(1);
+	}
+	treeModes[stemp[1]] = stemp[2];
+      }
+      else if(stemp[0] == "compression") {
+	if(stemp.size() < 3 || (stemp[1] != "normed" && stemp[1] != "output")) {
+	  cout << "compression needs normed or output and an algorithm: " << line << endl;
+	  exit(1);
+	}
+	string setting = (stemp.size() >= 4) ? stemp[2] + ":" + stemp[3] : stemp[2];
+	if(stemp[1] == "normed") normCompression = setting;
+	else outputCompression = setting;
+      }
+      else if(stemp[0].find("lumi") != string::npos) lumi = stod(stemp[1]);
       else if(stemp[0].find("output") != string::npos) output = stemp[1];
       else if(stemp[0].find("style") != string::npos) stylename = stemp[1];
       else if(plots.find(stemp[1]) == plots.end()) plots[stemp[1]] = new Normer(stemp);
@@ -134,41 +313,3 @@ void read_info(string filename, map<string, Normer*>& plots) {
     it->second->setLumi(lumi);
   }
 }
-
-bool process_dummy(string inConfig) {
-  ifstream indummy(".dummyinfo");
-  int configMod, plotterMod;
-  string configName;
-  if(indummy) {
-    string line;
-    getline(indummy, line);
-    plotterMod = stod(line);
-    getline(indummy, configName);
-    getline(indummy, line);
-    configMod = stod(line);
-  }
-  indummy.close();
-
-  int newPlotterMod = getModTime("Plotter");
-  int newConfigMod =  getModTime(inConfig.c_str());
-
-  ofstream outdummy(".dummyinfo");
-  outdummy << newPlotterMod << endl;
-  outdummy << inConfig << endl;
-  outdummy << newConfigMod << endl;
-
-  outdummy.close();
-
-  if((configMod < newConfigMod) || (plotterMod < newPlotterMod) || (configName != inConfig)) return true;
-  return false;
-
-}
-
-int getModTime(const char *path) {
-  struct stat attr;
-  stat(path, &attr);
-  char date[100] = {0};
-  strftime(date, 100, "%s", localtime(&attr.st_mtime));
-  return atoi(date);
-
-}